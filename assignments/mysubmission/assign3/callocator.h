@@ -0,0 +1,47 @@
+/* File: callocator.h
+ * ------------------
+ * Defines the CAllocator type, which lets a CVector or CMap get its memory
+ * from somewhere other than malloc/realloc/free.
+ *
+ * A CAllocator is a table of three functions and a context pointer that is
+ * passed back to each of them. Containers created with cvec_create_ex or
+ * cmap_create_ex make every allocation for their own storage through it,
+ * including the container struct itself. The container tells the
+ * allocator the current size of every block it resizes or frees, so an
+ * allocator that keeps no per-block size (a bump arena, or a wrapper that
+ * counts live bytes) can still be used.
+ */
+
+#ifndef _callocator_h
+#define _callocator_h
+
+#include <stddef.h> 	// size_t
+
+/**
+ * Type: CAllocator
+ * ----------------
+ * alloc returns a new block of at least size bytes, or NULL if it cannot.
+ * realloc resizes the block at ptr, currently oldsize bytes, to size
+ * bytes, preserving its contents as realloc does, or returns NULL leaving
+ * the block untouched. free releases the block at ptr of the given size.
+ * Blocks must be aligned to at least 8 bytes; element storage gets
+ * whatever alignment the allocator gives. context is passed as the first
+ * argument to each function.
+ */
+typedef struct {
+    void *(*alloc)(void *context, size_t size);
+    void *(*realloc)(void *context, void *ptr, size_t oldsize, size_t size);
+    void (*free)(void *context, void *ptr, size_t size);
+    void *context;
+} CAllocator;
+
+/**
+ * Constant: callocator_malloc
+ * ---------------------------
+ * A CAllocator that calls malloc, realloc and free, for clients that want
+ * to pass the standard allocator explicitly or wrap it. Containers
+ * created without an allocator use malloc directly.
+ */
+extern const CAllocator callocator_malloc;
+
+#endif
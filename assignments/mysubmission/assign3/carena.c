@@ -0,0 +1,139 @@
+/*
+ * File: carena.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * Chunked bump allocator. Chunks form a singly linked list, allocation
+ * only ever happens in the head chunk.
+ */
+#include <assert.h>
+#include "carena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// chunk size used when given chunksz_hint is 0
+#define DEFAULT_CHUNKSZ (64 * 1024)
+
+// every allocation is aligned to this many bytes
+#define ARENA_ALIGN 16
+
+typedef struct chunk chunk;
+struct chunk {
+    chunk *next; // previously filled chunk
+    size_t size; // bytes of storage following the header
+    size_t used; // bytes handed out so far
+    void *last;  // most recent allocation, the only one that can grow in place
+} __attribute__((aligned(ARENA_ALIGN)));
+
+// a registered cleanup action, stored inside the arena itself
+typedef struct deferred deferred;
+struct deferred {
+    deferred *next;
+    DeferredFn fn;
+    void *data;
+};
+
+/* Type: struct CArenaImplementation
+ * ---------------------------------
+ * This definition completes the CArena type that was declared in carena.h.
+ */
+struct CArenaImplementation {
+    chunk *head;          // chunk allocations are taken from
+    size_t chunksz;       // size of a regular chunk
+    deferred *deferred;   // cleanup actions, most recent first
+};
+
+static inline size_t roundup(size_t sz, size_t mult)
+{
+    return (sz + mult - 1) & ~(mult - 1);
+}
+
+static inline char *chunk_storage(chunk *c)
+{
+    return (char *)(c + 1);
+}
+
+// link a new chunk holding at least size bytes in front of the chunk list
+static chunk *add_chunk(CArena *arena, size_t size)
+{
+    size_t chunksz = size > arena->chunksz ? size : arena->chunksz;
+    chunk *c = malloc(sizeof(chunk) + chunksz);
+    assert(c != NULL);
+    c->size = chunksz;
+    c->used = 0;
+    c->last = NULL;
+    c->next = arena->head;
+    arena->head = c;
+    return c;
+}
+
+CArena *carena_create(size_t chunksz_hint)
+{
+    CArena *arena = malloc(sizeof(CArena));
+    assert(arena != NULL);
+    arena->chunksz = roundup(chunksz_hint == 0 ? DEFAULT_CHUNKSZ : chunksz_hint, ARENA_ALIGN);
+    arena->head = NULL;
+    arena->deferred = NULL;
+    return arena;
+}
+
+void carena_dispose(CArena *arena)
+{
+    for (deferred *d = arena->deferred; d != NULL; d = d->next)
+        d->fn(d->data);
+    chunk *next;
+    for (chunk *c = arena->head; c != NULL; c = next){
+        next = c->next;
+        free(c);
+    }
+    free(arena);
+}
+
+void *carena_alloc(CArena *arena, size_t size)
+{
+    size = roundup(size == 0 ? 1 : size, ARENA_ALIGN);
+    chunk *c = arena->head;
+    if (c == NULL || c->size - c->used < size){
+        // an oversized request gets its own chunk behind the head, so the
+        // head keeps its free space for the small requests that follow
+        if (c != NULL && size > arena->chunksz){
+            chunk *big = malloc(sizeof(chunk) + size);
+            assert(big != NULL);
+            big->size = big->used = size;
+            big->last = chunk_storage(big);
+            big->next = c->next;
+            c->next = big;
+            return big->last;
+        }
+        c = add_chunk(arena, size);
+    }
+    c->last = chunk_storage(c) + c->used;
+    c->used += size;
+    return c->last;
+}
+
+void *carena_grow(CArena *arena, void *ptr, size_t oldsz, size_t newsz)
+{
+    if (ptr == NULL) return carena_alloc(arena, newsz);
+    if (newsz <= oldsz) return ptr;
+    chunk *c = arena->head;
+    if (c != NULL && ptr == c->last){ // most recent allocation, try in place
+        size_t offset = (char *)ptr - chunk_storage(c);
+        size_t need = roundup(newsz, ARENA_ALIGN);
+        if (c->size - offset >= need){
+            c->used = offset + need;
+            return ptr;
+        }
+    }
+    void *moved = carena_alloc(arena, newsz);
+    memcpy(moved, ptr, oldsz);
+    return moved;
+}
+
+void carena_defer(CArena *arena, DeferredFn fn, void *data)
+{
+    deferred *d = carena_alloc(arena, sizeof(deferred));
+    d->fn = fn;
+    d->data = data;
+    d->next = arena->deferred;
+    arena->deferred = d;
+}
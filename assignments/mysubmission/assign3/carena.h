@@ -0,0 +1,107 @@
+/* File: carena.h
+ * --------------
+ * Defines the interface for the CArena type.
+ *
+ * The CArena is a region allocator for objects whose lifetimes all end
+ * together. Allocation bumps a pointer through large chunks of memory
+ * obtained from the heap, and nothing is freed individually. When the
+ * arena is disposed, any cleanup actions registered with it are run and
+ * then every chunk is released at once. CVectors can be created inside an
+ * arena (see cvec_create_in) so that thousands of small vectors cost a few
+ * chunk allocations instead of thousands of malloc/realloc/free calls.
+ */
+
+#ifndef _carena_h
+#define _carena_h
+
+#include <stddef.h> 	// size_t
+
+
+/**
+ * Type: CArena
+ * ------------
+ * Defines the CArena type. Like the CVector, the type is incomplete and
+ * clients only ever hold CArena* pointers.
+ */
+typedef struct CArenaImplementation CArena;
+
+
+/**
+ * Type: DeferredFn
+ * ----------------
+ * DeferredFn is the typename for a pointer to a client-supplied function
+ * that the arena calls during carena_dispose, before releasing its memory.
+ * It takes the void* data pointer that was registered with it.
+ */
+typedef void (*DeferredFn)(void *data);
+
+
+/**
+ * Function: carena_create
+ * Usage: CArena *arena = carena_create(0)
+ * ---------------------------------------
+ * Creates a new empty CArena and returns a pointer to it. The chunksz_hint
+ * parameter is the size in bytes of each chunk the arena obtains from the
+ * heap. If chunksz_hint is 0, an internal default value is used. Requests
+ * larger than a chunk get a dedicated chunk of their own.
+ *
+ * Asserts: allocation failure
+ */
+CArena *carena_create(size_t chunksz_hint);
+
+
+/**
+ * Function: carena_dispose
+ * Usage: carena_dispose(arena)
+ * ----------------------------
+ * Disposes of the CArena. First calls every function registered with
+ * carena_defer, most recently registered first, then releases all chunks.
+ * Any pointer previously returned by the arena is invalid afterwards.
+ * Operates in time linear in the number of chunks and deferred functions.
+ */
+void carena_dispose(CArena *arena);
+
+
+/**
+ * Function: carena_alloc
+ * Usage: int *arr = carena_alloc(arena, 10 * sizeof(int))
+ * -------------------------------------------------------
+ * Returns a pointer to size bytes of uninitialized storage inside the
+ * arena, aligned to 16 bytes. The storage remains valid until the arena
+ * is disposed. Operates in constant-time.
+ *
+ * Asserts: allocation failure
+ */
+void *carena_alloc(CArena *arena, size_t size);
+
+
+/**
+ * Function: carena_grow
+ * Usage: arr = carena_grow(arena, arr, 10 * sizeof(int), 20 * sizeof(int))
+ * ------------------------------------------------------------------------
+ * Enlarges a previous allocation from oldsz to newsz bytes, preserving its
+ * contents, and returns its (possibly new) address. If ptr is the most recent
+ * allocation in its chunk and the chunk has room, the allocation is extended
+ * in place. Otherwise new storage is allocated and the contents copied; the
+ * old storage is not reclaimed until the arena is disposed. If ptr is NULL,
+ * behaves like carena_alloc.
+ *
+ * Asserts: allocation failure
+ * Assumes: ptr was returned by this arena with size oldsz
+ */
+void *carena_grow(CArena *arena, void *ptr, size_t oldsz, size_t newsz);
+
+
+/**
+ * Function: carena_defer
+ * Usage: carena_defer(arena, close_file, fp)
+ * ------------------------------------------
+ * Registers fn to be called with data when the arena is disposed, before
+ * its memory is released. Used to clean up resources owned by objects
+ * living in the arena. Operates in constant-time.
+ *
+ * Asserts: allocation failure
+ */
+void carena_defer(CArena *arena, DeferredFn fn, void *data);
+
+#endif
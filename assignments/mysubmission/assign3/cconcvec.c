@@ -0,0 +1,146 @@
+/*
+ * File: cconcvec.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * Segments are laid out as in csegvector.c. Each segment is followed by a
+ * byte per slot that is set once the slot's element has been written. The
+ * published count is pushed forward over ready slots by whichever
+ * appending thread finds it can.
+ */
+#include <assert.h>
+#include "cconcvec.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a suggested value to use when given capacity_hint is 0
+#define DEFAULT_CAPACITY 16
+
+// enough segments for INT_MAX elements even when the first segment holds 1
+#define MAX_SEGMENTS 32
+
+/* Type: struct CConcVecImplementation
+ * -----------------------------------
+ * This definition completes the CConcVec type that was declared in
+ * cconcvec.h. segs, claimed and published are only accessed atomically.
+ */
+struct CConcVecImplementation {
+    char *segs[MAX_SEGMENTS];// segment directory, NULL until first needed
+    size_t claimed;// slots handed out to appends
+    size_t published;// slots [0, published) are written and readable
+    size_t elemsz;// size of individual elements in bytes
+    unsigned shift;// log2 of the first segment's capacity
+    CleanupElemFn cleanup;// client function applied to elements being disposed
+};
+
+// capacity of segment k
+static inline size_t seg_len(const CConcVec *cv, int k)
+{
+    return (size_t)1 << (cv->shift + k);
+}
+
+// segment holding index i, and i's offset within it
+static inline int locate(const CConcVec *cv, size_t i, size_t *poff)
+{
+    size_t j = i + ((size_t)1 << cv->shift);
+    int top = 63 - __builtin_clzl(j);
+    *poff = j ^ ((size_t)1 << top);
+    return top - cv->shift;
+}
+
+// ready flag of the slot at offset off in segment k
+static inline unsigned char *ready_flag(const CConcVec *cv, char *seg, int k, size_t off)
+{
+    return (unsigned char *)seg + seg_len(cv, k) * cv->elemsz + off;
+}
+
+// segment k, allocating it if this thread is first to need it. Racing
+// threads each allocate, one wins the compare-and-swap, the rest free theirs
+static char *get_segment(CConcVec *cv, int k)
+{
+    char *seg = __atomic_load_n(&cv->segs[k], __ATOMIC_ACQUIRE);
+    if (seg != NULL) return seg;
+    size_t len = seg_len(cv, k);
+    char *fresh = malloc(len * cv->elemsz + len);
+    assert(fresh != NULL);
+    memset(fresh + len * cv->elemsz, 0, len); // no slot ready yet
+    if (__atomic_compare_exchange_n(&cv->segs[k], &seg, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return fresh;
+    free(fresh);
+    return seg; // the winner's segment, loaded by the failed exchange
+}
+
+// advance published past every consecutive ready slot. A slot not yet
+// claimed is never ready, so there is no need to look at claimed
+static void publish(CConcVec *cv)
+{
+    size_t p = __atomic_load_n(&cv->published, __ATOMIC_SEQ_CST);
+    for (;;){
+        size_t off;
+        int k = locate(cv, p, &off);
+        char *seg = __atomic_load_n(&cv->segs[k], __ATOMIC_ACQUIRE);
+        if (seg == NULL || !__atomic_load_n(ready_flag(cv, seg, k, off), __ATOMIC_SEQ_CST)) return;
+        // on failure p is reloaded with whatever another thread published
+        if (__atomic_compare_exchange_n(&cv->published, &p, p + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            p++;
+    }
+}
+
+CConcVec *cconcvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+{
+    assert(elemsz > 0);
+    CConcVec *cv = malloc(sizeof(CConcVec));
+    assert(cv != NULL);
+    size_t first = capacity_hint == 0 ? DEFAULT_CAPACITY : capacity_hint;
+    cv->shift = 0;
+    while (((size_t)1 << cv->shift) < first && cv->shift < 30) cv->shift++;
+    memset(cv->segs, 0, sizeof(cv->segs));
+    cv->claimed = 0;
+    cv->published = 0;
+    cv->elemsz = elemsz;
+    cv->cleanup = fn;
+    return cv;
+}
+
+void cconcvec_dispose(CConcVec *cv)
+{
+    if (cv->cleanup != NULL){
+        for (size_t i = 0; i < cv->published; i++){
+            size_t off;
+            int k = locate(cv, i, &off);
+            cv->cleanup(cv->segs[k] + off * cv->elemsz);
+        }
+    }
+    for (int k = 0; k < MAX_SEGMENTS; k++) free(cv->segs[k]);
+    free(cv);
+}
+
+int cconcvec_append(CConcVec *cv, const void *addr)
+{
+    size_t index = __atomic_fetch_add(&cv->claimed, 1, __ATOMIC_SEQ_CST);
+    assert(index < INT_MAX);
+    size_t off;
+    int k = locate(cv, index, &off);
+    char *seg = get_segment(cv, k);
+    memcpy(seg + off * cv->elemsz, addr, cv->elemsz);
+    // orders the element before the flag. Being seq_cst, a thread that has
+    // just published up to this slot either sees the flag or has published
+    // before this thread's own publish loads the count
+    __atomic_store_n(ready_flag(cv, seg, k, off), 1, __ATOMIC_SEQ_CST);
+    publish(cv);
+    return (int)index;
+}
+
+int cconcvec_count(const CConcVec *cv)
+{
+    return (int)__atomic_load_n(&cv->published, __ATOMIC_ACQUIRE);
+}
+
+void *cconcvec_nth(const CConcVec *cv, int index)
+{
+    assert(index >= 0 && index < cconcvec_count(cv));
+    size_t off;
+    int k = locate(cv, index, &off);
+    return __atomic_load_n(&cv->segs[k], __ATOMIC_ACQUIRE) + off * cv->elemsz;
+}
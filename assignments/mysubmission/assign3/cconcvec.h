@@ -0,0 +1,101 @@
+/* File: cconcvec.h
+ * ----------------
+ * Defines the interface for the CConcVec type.
+ *
+ * The CConcVec is an append-only vector that many threads can append to
+ * and read from at the same time without locks. An append claims the next
+ * slot with an atomic increment, so appending threads never wait for each
+ * other except to publish: elements become visible to readers strictly in
+ * index order, once every slot before them has been filled. Storage grows
+ * by adding segments of doubling size (as in CSegVector), so elements are
+ * never moved and a reader never sees storage disappear under it.
+ *
+ * Creating and disposing are not thread-safe: the client must make sure no
+ * other thread is using the CConcVec when it is disposed.
+ */
+
+#ifndef _cconcvec_h
+#define _cconcvec_h
+
+#include "cvector.h"	// CleanupElemFn
+
+/**
+ * Type: CConcVec
+ * --------------
+ * Defines the CConcVec type. The type is incomplete and clients only ever
+ * hold CConcVec* pointers.
+ */
+typedef struct CConcVecImplementation CConcVec;
+
+
+/**
+ * Function: cconcvec_create
+ * Usage: CConcVec *v = cconcvec_create(sizeof(char *), 1024, free_path)
+ * ---------------------------------------------------------------------
+ * Creates a new empty CConcVec. elemsz, capacity_hint and fn are as for
+ * csegvec_create: the hint, rounded up to a power of two, sizes the first
+ * segment, and fn is called on every element at dispose.
+ *
+ * Asserts: zero elemsz, allocation failure
+ * Assumes: cleanup fn is valid
+ */
+CConcVec *cconcvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
+
+
+/**
+ * Function: cconcvec_dispose
+ * Usage: cconcvec_dispose(v)
+ * --------------------------
+ * Calls the client's cleanup function on each element and deallocates the
+ * CConcVec. Must not be called while other threads use the CConcVec.
+ * Operates in linear-time.
+ */
+void cconcvec_dispose(CConcVec *cv);
+
+
+/**
+ * Function: cconcvec_append
+ * Usage: int index = cconcvec_append(v, &elem)
+ * --------------------------------------------
+ * Adds a copy of the element at addr to the end and returns its index.
+ * Safe to call from any number of threads at once. The element is visible
+ * to cconcvec_count/cconcvec_nth once it and every element before it have
+ * been written, which may be after this call returns if another thread is
+ * still writing an earlier slot. Operates in constant-time, lock-free
+ * except for the allocation of a new segment.
+ *
+ * Asserts: allocation failure, more than INT_MAX elements
+ * Assumes: address of valid elem
+ */
+int cconcvec_append(CConcVec *cv, const void *addr);
+
+
+/**
+ * Function: cconcvec_count
+ * Usage: int count = cconcvec_count(v)
+ * ------------------------------------
+ * Returns the published count: elements 0 to count - 1 are fully written
+ * and may be read. Safe to call concurrently with appends. The count only
+ * grows, so a reader can iterate with a snapshot of it:
+ *
+ *     for (int i = 0, n = cconcvec_count(v); i < n; i++)
+ *         use(cconcvec_nth(v, i));
+ *
+ * Operates in constant-time.
+ */
+int cconcvec_count(const CConcVec *cv);
+
+
+/**
+ * Function: cconcvec_nth
+ * Usage: char *path = *(char **)cconcvec_nth(v, 0)
+ * ------------------------------------------------
+ * Returns a pointer to the element at a published index. The pointer stays
+ * valid until the CConcVec is disposed. Safe to call concurrently with
+ * appends. Operates in constant-time.
+ *
+ * Asserts: index not published
+ */
+void *cconcvec_nth(const CConcVec *cv, int index);
+
+#endif
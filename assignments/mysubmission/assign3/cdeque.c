@@ -0,0 +1,135 @@
+/*
+ * File: cdeque.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * Circular buffer with a power-of-two capacity, so positions wrap with a
+ * mask instead of a modulus.
+ */
+#include <assert.h>
+#include "cdeque.h"
+#include "cvector_template.h"	// struct cvec_layout
+#include <stdlib.h>
+#include <string.h>
+
+// a suggested value to use when given capacity_hint is 0
+#define DEFAULT_CAPACITY 16
+
+/* Type: struct CDequeImplementation
+ * ---------------------------------
+ * This definition completes the CDeque type that was declared in cdeque.h.
+ */
+struct CDequeImplementation {
+    char *elems;// circular buffer
+    size_t mask;// capacity - 1, capacity is a power of 2
+    size_t head;// slot of the front element
+    size_t size;// count of elements stored
+    size_t elemsz;// size of individual elements in bytes
+    CleanupElemFn cleanup;// client function applied to elements being disposed
+};
+
+// address of the element index places from the front
+static inline char *slot(const CDeque *cd, size_t index)
+{
+    return cd->elems + ((cd->head + index) & cd->mask) * cd->elemsz;
+}
+
+// double the capacity, unwrapping the elements to start at slot 0
+static void grow(CDeque *cd)
+{
+    size_t cap = cd->mask + 1;
+    char *elems = malloc(2 * cap * cd->elemsz);
+    assert(elems != NULL);
+    size_t first = cap - cd->head; // elements from head to the end of the buffer
+    memcpy(elems, cd->elems + cd->head * cd->elemsz, first * cd->elemsz);
+    memcpy(elems + first * cd->elemsz, cd->elems, cd->head * cd->elemsz);
+    free(cd->elems);
+    cd->elems = elems;
+    cd->mask = 2 * cap - 1;
+    cd->head = 0;
+}
+
+CDeque *cdeque_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+{
+    assert(elemsz > 0);
+    CDeque *cd = malloc(sizeof(CDeque));
+    assert(cd != NULL);
+    size_t cap = 1, want = capacity_hint == 0 ? DEFAULT_CAPACITY : capacity_hint;
+    while (cap < want) cap <<= 1;
+    cd->elems = malloc(cap * elemsz);
+    assert(cd->elems != NULL);
+    cd->mask = cap - 1;
+    cd->head = 0;
+    cd->size = 0;
+    cd->elemsz = elemsz;
+    cd->cleanup = fn;
+    return cd;
+}
+
+void cdeque_dispose(CDeque *cd)
+{
+    if (cd->cleanup != NULL){
+        for (size_t i = 0; i < cd->size; i++) cd->cleanup(slot(cd, i));
+    }
+    free(cd->elems);
+    free(cd);
+}
+
+int cdeque_count(const CDeque *cd)
+{
+    return (int)cd->size;
+}
+
+void *cdeque_nth(const CDeque *cd, int index)
+{
+    assert(index >= 0 && index < cd->size);
+    return slot(cd, index);
+}
+
+void cdeque_push_front(CDeque *cd, const void *addr)
+{
+    if (cd->size > cd->mask) grow(cd);
+    cd->head = (cd->head - 1) & cd->mask;
+    memcpy(cd->elems + cd->head * cd->elemsz, addr, cd->elemsz);
+    cd->size++;
+}
+
+void cdeque_push_back(CDeque *cd, const void *addr)
+{
+    if (cd->size > cd->mask) grow(cd);
+    memcpy(slot(cd, cd->size), addr, cd->elemsz);
+    cd->size++;
+}
+
+// hand the element to the client if addr is given, clean it up otherwise
+static void take(CDeque *cd, void *elem, void *addr)
+{
+    if (addr != NULL) memcpy(addr, elem, cd->elemsz);
+    else if (cd->cleanup != NULL) cd->cleanup(elem);
+}
+
+void cdeque_pop_front(CDeque *cd, void *addr)
+{
+    assert(cd->size > 0);
+    take(cd, slot(cd, 0), addr);
+    cd->head = (cd->head + 1) & cd->mask;
+    cd->size--;
+}
+
+void cdeque_pop_back(CDeque *cd, void *addr)
+{
+    assert(cd->size > 0);
+    take(cd, slot(cd, cd->size - 1), addr);
+    cd->size--;
+}
+
+void cdeque_copy_to(const CDeque *cd, CVector *cv)
+{
+    assert(((const struct cvec_layout *)cv)->elemsz == cd->elemsz);
+    size_t first = cd->mask + 1 - cd->head; // run from head to the end of the buffer
+    if (first >= cd->size){
+        cvec_append_n(cv, slot(cd, 0), cd->size);
+    }else{
+        cvec_append_n(cv, slot(cd, 0), first);
+        cvec_append_n(cv, cd->elems, cd->size - first);
+    }
+}
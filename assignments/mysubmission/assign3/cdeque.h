@@ -0,0 +1,118 @@
+/* File: cdeque.h
+ * --------------
+ * Defines the interface for the CDeque type.
+ *
+ * The CDeque is a double-ended queue: elements are added and removed at
+ * either end in constant time, which makes it the right container for
+ * queues, breadth-first search frontiers and sliding windows where a
+ * CVector would shift every element on each insert at index 0. Elements
+ * are stored in a circular buffer whose capacity is a power of two. As for
+ * the CVector, all elements are the same size, are copied in and out by
+ * value, and may have a cleanup function.
+ */
+
+#ifndef _cdeque_h
+#define _cdeque_h
+
+#include "cvector.h"	// CleanupElemFn, CVector
+
+/**
+ * Type: CDeque
+ * ------------
+ * Defines the CDeque type. The type is incomplete and clients only ever
+ * hold CDeque* pointers.
+ */
+typedef struct CDequeImplementation CDeque;
+
+
+/**
+ * Function: cdeque_create
+ * Usage: CDeque *q = cdeque_create(sizeof(int), 10, NULL)
+ * -------------------------------------------------------
+ * Creates a new empty CDeque with room for capacity_hint elements rounded
+ * up to a power of two (an internal default if 0). The elemsz and fn
+ * parameters are as for cvec_create: fn is called on an element when it is
+ * popped without being copied out and on every element at dispose.
+ *
+ * Asserts: zero elemsz, allocation failure
+ * Assumes: cleanup fn is valid
+ */
+CDeque *cdeque_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
+
+
+/**
+ * Function: cdeque_dispose
+ * Usage: cdeque_dispose(q)
+ * ------------------------
+ * Calls the client's cleanup function on each element and deallocates the
+ * CDeque. Operates in linear-time.
+ */
+void cdeque_dispose(CDeque *cd);
+
+
+/**
+ * Function: cdeque_count
+ * Usage: int count = cdeque_count(q)
+ * ----------------------------------
+ * Returns the number of elements stored. Operates in constant-time.
+ */
+int cdeque_count(const CDeque *cd);
+
+
+/**
+ * Function: cdeque_nth
+ * Usage: int front = *(int *)cdeque_nth(q, 0)
+ * -------------------------------------------
+ * Returns a pointer to the element at the given index, counting from the
+ * front. The pointer is invalidated by any push or pop. Operates in
+ * constant-time.
+ *
+ * Asserts: invalid index
+ */
+void *cdeque_nth(const CDeque *cd, int index);
+
+
+/**
+ * Functions: cdeque_push_front, cdeque_push_back
+ * Usage: cdeque_push_back(q, &elem)
+ * ---------------------------------
+ * Add a copy of the element at addr at the front or back. When the buffer
+ * is full its capacity doubles. Operates in amortized constant-time.
+ *
+ * Asserts: allocation failure
+ * Assumes: address of valid elem
+ */
+void cdeque_push_front(CDeque *cd, const void *addr);
+void cdeque_push_back(CDeque *cd, const void *addr);
+
+
+/**
+ * Functions: cdeque_pop_front, cdeque_pop_back
+ * Usage: int front;
+ *        cdeque_pop_front(q, &front)
+ * ----------------------------------
+ * Remove the element at the front or back. If addr is not NULL the element
+ * is copied to addr and the client becomes responsible for it; if addr is
+ * NULL the client's cleanup function is called on it instead. Operates in
+ * constant-time.
+ *
+ * Asserts: empty CDeque
+ */
+void cdeque_pop_front(CDeque *cd, void *addr);
+void cdeque_pop_back(CDeque *cd, void *addr);
+
+
+/**
+ * Function: cdeque_copy_to
+ * Usage: cdeque_copy_to(q, v)
+ * ---------------------------
+ * Appends copies of all elements, front to back, to the end of the given
+ * CVector, which must have the same elemsz. The copies are shallow: if the
+ * elements own memory, only one of the two containers should have a cleanup
+ * function. Copies at most two contiguous runs. Operates in linear-time.
+ *
+ * Asserts: elemsz mismatch, allocation failure
+ */
+void cdeque_copy_to(const CDeque *cd, CVector *cv);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * File: cheap.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * Binary heap stored in a CVector, element i has children 2i+1 and 2i+2.
+ * The heap functions work on raw element arrays so cvec_topk can reuse
+ * them for its fallback selection.
+ */
+#include <assert.h>
+#include "cheap.h"
+#include "cvector_template.h"	// struct cvec_layout
+#include <stdlib.h>
+#include <string.h>
+
+// a suggested value to use when given capacity_hint is 0
+#define DEFAULT_CAPACITY 16
+
+// below this many elements introselect finishes with insertion sort
+#define SELECT_CUTOFF 16
+
+/* Type: struct CHeapImplementation
+ * --------------------------------
+ * This definition completes the CHeap type that was declared in cheap.h.
+ */
+struct CHeapImplementation {
+    CVector *cv;// heap-ordered elements, has no cleanup fn of its own
+    CompareFn cmp;// client ordering, smallest on top
+    CleanupElemFn cleanup;// client function applied to elements being disposed
+};
+
+// raw element storage of a CVector
+static inline char *elems_of(const CVector *cv)
+{
+    return ((const struct cvec_layout *)cv)->elems;
+}
+
+static void swap_elems(char *a, char *b, size_t sz)
+{
+    char tmp[64];
+    while (sz > 0){
+        size_t n = sz < sizeof(tmp) ? sz : sizeof(tmp);
+        memcpy(tmp, a, n);
+        memcpy(a, b, n);
+        memcpy(b, tmp, n);
+        a += n;
+        b += n;
+        sz -= n;
+    }
+}
+
+// restore heap order below root. dir is 1 for a min-heap, -1 for a max-heap
+static void sift_down(char *base, size_t root, size_t n, size_t sz, CompareFn cmp, int dir)
+{
+    for (size_t child; (child = 2 * root + 1) < n; root = child){
+        if (child + 1 < n && dir * cmp(base + (child + 1) * sz, base + child * sz) < 0) child++;
+        if (dir * cmp(base + child * sz, base + root * sz) >= 0) return;
+        swap_elems(base + root * sz, base + child * sz, sz);
+    }
+}
+
+static void sift_up(char *base, size_t i, size_t sz, CompareFn cmp)
+{
+    while (i > 0){
+        size_t parent = (i - 1) / 2;
+        if (cmp(base + i * sz, base + parent * sz) >= 0) return;
+        swap_elems(base + i * sz, base + parent * sz, sz);
+        i = parent;
+    }
+}
+
+// establish heap order over all n elements, bottom-up in linear time
+static void build_heap(char *base, size_t n, size_t sz, CompareFn cmp, int dir)
+{
+    for (size_t i = n / 2; i > 0; i--) sift_down(base, i - 1, n, sz, cmp, dir);
+}
+
+CHeap *cheap_create(size_t elemsz, size_t capacity_hint, CompareFn cmp, CleanupElemFn fn)
+{
+    CHeap *h = malloc(sizeof(CHeap));
+    assert(h != NULL);
+    h->cv = cvec_create(elemsz, capacity_hint == 0 ? DEFAULT_CAPACITY : capacity_hint, NULL);
+    h->cmp = cmp;
+    h->cleanup = fn;
+    return h;
+}
+
+void cheap_dispose(CHeap *h)
+{
+    if (h->cleanup != NULL){
+        for (void *cur = cvec_first(h->cv); cur != NULL; cur = cvec_next(h->cv, cur))
+            h->cleanup(cur);
+    }
+    cvec_dispose(h->cv);
+    free(h);
+}
+
+int cheap_count(const CHeap *h)
+{
+    return cvec_count(h->cv);
+}
+
+void *cheap_peek(const CHeap *h)
+{
+    return cvec_count(h->cv) == 0 ? NULL : elems_of(h->cv);
+}
+
+void cheap_push(CHeap *h, const void *addr)
+{
+    cvec_append(h->cv, addr);
+    sift_up(elems_of(h->cv), cvec_count(h->cv) - 1, ((struct cvec_layout *)h->cv)->elemsz, h->cmp);
+}
+
+void cheap_pop(CHeap *h, void *addr)
+{
+    int n = cvec_count(h->cv);
+    assert(n > 0);
+    size_t sz = ((struct cvec_layout *)h->cv)->elemsz;
+    char *base = elems_of(h->cv);
+    if (addr != NULL) memcpy(addr, base, sz);
+    else if (h->cleanup != NULL) h->cleanup(base);
+    if (n > 1) memcpy(base, base + (n - 1) * sz, sz); // last element takes the top, then sinks
+    cvec_remove(h->cv, n - 1);
+    sift_down(base, 0, n - 1, sz, h->cmp, 1);
+}
+
+bool cheap_push_bounded(CHeap *h, const void *addr, int k)
+{
+    assert(k > 0);
+    if (cvec_count(h->cv) < k){
+        cheap_push(h, addr);
+        return true;
+    }
+    char *base = elems_of(h->cv);
+    if (h->cmp(addr, base) <= 0) return false;
+    size_t sz = ((struct cvec_layout *)h->cv)->elemsz;
+    if (h->cleanup != NULL) h->cleanup(base);
+    memcpy(base, addr, sz);
+    sift_down(base, 0, cvec_count(h->cv), sz, h->cmp, 1);
+    return true;
+}
+
+void cheap_heapify(CHeap *h, const void *addr, size_t n)
+{
+    cvec_append_n(h->cv, addr, n);
+    build_heap(elems_of(h->cv), cvec_count(h->cv), ((struct cvec_layout *)h->cv)->elemsz, h->cmp, 1);
+}
+
+// leave the k smallest of n elements in [0, k) using a max-heap of k
+static void heap_select(char *base, size_t n, size_t k, size_t sz, CompareFn cmp)
+{
+    if (k == 0) return;
+    build_heap(base, k, sz, cmp, -1);
+    for (size_t i = k; i < n; i++){
+        if (cmp(base + i * sz, base) < 0){
+            swap_elems(base + i * sz, base, sz);
+            sift_down(base, 0, k, sz, cmp, -1);
+        }
+    }
+}
+
+static void insertion_sort(char *base, size_t n, size_t sz, CompareFn cmp)
+{
+    for (size_t i = 1; i < n; i++){
+        for (size_t j = i; j > 0 && cmp(base + j * sz, base + (j - 1) * sz) < 0; j--)
+            swap_elems(base + j * sz, base + (j - 1) * sz, sz);
+    }
+}
+
+// partition until every element of [0, k) compares <= every element of [k, n)
+static void introselect(char *base, size_t n, size_t k, size_t sz, CompareFn cmp, char *pivot)
+{
+    int depth = 0;
+    for (size_t m = n; m > 1; m >>= 1) depth += 2;
+    while (n > SELECT_CUTOFF){
+        if (depth-- == 0){ // partitions keep coming out lopsided
+            heap_select(base, n, k, sz, cmp);
+            return;
+        }
+        // median of 3 also leaves sentinels at both ends for the scans
+        char *mid = base + n / 2 * sz, *last = base + (n - 1) * sz;
+        if (cmp(mid, base) < 0) swap_elems(mid, base, sz);
+        if (cmp(last, mid) < 0){
+            swap_elems(last, mid, sz);
+            if (cmp(mid, base) < 0) swap_elems(mid, base, sz);
+        }
+        memcpy(pivot, mid, sz);
+        size_t i = 0, j = n - 1;
+        for (;;){
+            while (cmp(base + i * sz, pivot) < 0) i++;
+            while (cmp(pivot, base + j * sz) < 0) j--;
+            if (i >= j) break;
+            swap_elems(base + i++ * sz, base + j-- * sz, sz);
+        }
+        size_t left = j + 1; // [0, left) <= pivot <= [left, n)
+        if (k == left) return;
+        if (k < left){
+            n = left;
+        }else{
+            base += left * sz;
+            n -= left;
+            k -= left;
+        }
+    }
+    insertion_sort(base, n, sz, cmp);
+}
+
+void cvec_topk(CVector *cv, int k, CompareFn cmp)
+{
+    int n = cvec_count(cv);
+    assert(k >= 0 && k <= n);
+    if (k == 0) return;
+    size_t sz = ((struct cvec_layout *)cv)->elemsz;
+    char *pivot = malloc(sz);
+    assert(pivot != NULL);
+    introselect(elems_of(cv), n, k, sz, cmp, pivot);
+    free(pivot);
+    qsort(elems_of(cv), k, sz, cmp);
+}
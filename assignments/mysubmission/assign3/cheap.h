@@ -0,0 +1,145 @@
+/* File: cheap.h
+ * -------------
+ * Defines the interface for the CHeap type and for top-k selection on a
+ * CVector.
+ *
+ * The CHeap is a priority queue kept as a binary heap in CVector storage.
+ * The element that compares smallest under the client's CompareFn is at
+ * the top; pass a reversed comparison to get the largest at the top. A
+ * bounded push turns the CHeap into a streaming top-k filter: it keeps the
+ * k greatest elements seen so far using memory for only k elements.
+ */
+
+#ifndef _cheap_h
+#define _cheap_h
+
+#include "cvector.h"	// CompareFn, CleanupElemFn, CVector
+
+/**
+ * Type: CHeap
+ * -----------
+ * Defines the CHeap type. The type is incomplete and clients only ever
+ * hold CHeap* pointers.
+ */
+typedef struct CHeapImplementation CHeap;
+
+
+/**
+ * Function: cheap_create
+ * Usage: CHeap *h = cheap_create(sizeof(int), 10, cmp_int, NULL)
+ * --------------------------------------------------------------
+ * Creates a new empty CHeap ordered by cmp. The elemsz, capacity_hint and
+ * fn parameters are as for cvec_create: fn is called on an element when it
+ * is popped without being copied out, when it is evicted by a bounded
+ * push, and on every element at dispose.
+ *
+ * Asserts: zero elemsz, allocation failure
+ * Assumes: cmp and cleanup fn are valid
+ */
+CHeap *cheap_create(size_t elemsz, size_t capacity_hint, CompareFn cmp, CleanupElemFn fn);
+
+
+/**
+ * Function: cheap_dispose
+ * Usage: cheap_dispose(h)
+ * -----------------------
+ * Calls the client's cleanup function on each element and deallocates the
+ * CHeap. Operates in linear-time.
+ */
+void cheap_dispose(CHeap *h);
+
+
+/**
+ * Function: cheap_count
+ * Usage: int count = cheap_count(h)
+ * ---------------------------------
+ * Returns the number of elements stored. Operates in constant-time.
+ */
+int cheap_count(const CHeap *h);
+
+
+/**
+ * Function: cheap_peek
+ * Usage: int smallest = *(int *)cheap_peek(h)
+ * -------------------------------------------
+ * Returns a pointer to the top element, the one that compares smallest, or
+ * NULL if the CHeap is empty. The pointer is invalidated by any change to
+ * the CHeap. Operates in constant-time.
+ */
+void *cheap_peek(const CHeap *h);
+
+
+/**
+ * Function: cheap_push
+ * Usage: cheap_push(h, &elem)
+ * ---------------------------
+ * Adds a copy of the element at addr. Operates in logarithmic-time.
+ *
+ * Asserts: allocation failure
+ * Assumes: address of valid elem
+ */
+void cheap_push(CHeap *h, const void *addr);
+
+
+/**
+ * Function: cheap_pop
+ * Usage: cheap_pop(h, &smallest)
+ * ------------------------------
+ * Removes the top element. If addr is not NULL the element is copied to
+ * addr and the client becomes responsible for it; if addr is NULL the
+ * client's cleanup function is called on it instead. Popping until empty
+ * visits elements in ascending order. Operates in logarithmic-time.
+ *
+ * Asserts: empty CHeap
+ */
+void cheap_pop(CHeap *h, void *addr);
+
+
+/**
+ * Function: cheap_push_bounded
+ * Usage: cheap_push_bounded(h, &elem, 10)
+ * ---------------------------------------
+ * Adds a copy of the element at addr while keeping no more than k elements,
+ * so that after any sequence of bounded pushes the CHeap holds the k
+ * elements that compare greatest, with the least of those at the top.
+ * Once k elements are stored, a new element that does not compare greater
+ * than the top is not added, and one that does replaces the top, which is
+ * cleaned up. Returns true if the element was added. Operates in
+ * logarithmic-time.
+ *
+ * Asserts: k is zero, allocation failure
+ * Assumes: address of valid elem
+ */
+bool cheap_push_bounded(CHeap *h, const void *addr, int k);
+
+
+/**
+ * Function: cheap_heapify
+ * Usage: cheap_heapify(h, array, n)
+ * ---------------------------------
+ * Adds copies of n contiguous elements starting at addr and restores the
+ * heap order once at the end, which takes linear time rather than the
+ * n log n of n pushes.
+ *
+ * Asserts: allocation failure
+ * Assumes: addr points to n valid elements
+ */
+void cheap_heapify(CHeap *h, const void *addr, size_t n);
+
+
+/**
+ * Function: cvec_topk
+ * Usage: cvec_topk(v, 10, cmp_int)
+ * --------------------------------
+ * Rearranges the elements of the CVector so that the first k are the k
+ * smallest under cmp, in ascending order. The order of the rest is
+ * unspecified. Uses introselect, which is quickselect falling back to a
+ * heap-based selection if partitioning goes badly, followed by sorting
+ * only the first k. Operates in linear-time plus k log k, in place.
+ *
+ * Asserts: k out of range
+ * Assumes: cmp fn is valid
+ */
+void cvec_topk(CVector *cv, int k, CompareFn cmp);
+
+#endif
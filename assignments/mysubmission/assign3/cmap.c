@@ -6,6 +6,8 @@
  */
 
 #include "cmap.h"
+#include "cvmstats.h"
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -24,6 +26,8 @@ struct CMapImplementation {
     void **buckets; //points to first bucket in the bucket array which stores pointer to linkedlists
     size_t valuesz; //size of each value, provided by user
     size_t size; //number of <key,value pair stored in cmap
+    CleanupValueFn cleanup; // client function applied to values being replaced or disposed
+    const CAllocator *allocator; // source of all memory, NULL for malloc
 };
 
 
@@ -57,46 +61,67 @@ static int hash(const char *s, int nbuckets)
 {
     const unsigned long MULTIPLIER = 2630849305L; // magic number
     unsigned long hashcode = 0;
+    CVM_COUNT(hashes, 1);
     for (int i = 0; s[i] != '\0'; i++)
         hashcode = hashcode * MULTIPLIER + s[i];
     return hashcode % nbuckets;
 }
 
 
-CMap *cmap_create(size_t valuesz, size_t capacity_hint, CleanupValueFn fn)
+// memory comes from the client's allocator if the CMap has one
+static void *map_alloc(const CAllocator *allocator, size_t nbytes)
 {
-    CMap *cm = malloc(sizeof(CMap));
+    void *p = allocator ? allocator->alloc(allocator->context, nbytes) : malloc(nbytes);
+    assert(p != NULL);
+    return p;
+}
+
+static void map_free(const CAllocator *allocator, void *ptr, size_t nbytes)
+{
+    if (allocator) allocator->free(allocator->context, ptr, nbytes);
+    else free(ptr);
+}
+
+// bytes in the cell holding key: next pointer, key with terminator, value
+static inline size_t cell_size(const char *key, size_t valuesz)
+{
+    return sizeof(void *) + strlen(key) + 1 + valuesz;
+}
+
+CMap *cmap_create_ex(const CAllocator *allocator, size_t valuesz, size_t capacity_hint, CleanupValueFn fn)
+{
+    assert(valuesz > 0);
+    CMap *cm = map_alloc(allocator, sizeof(CMap));
+    cm->allocator = allocator;
     cm->nbuckets = capacity_hint == 0 ? DEFAULT_CAPACITY : capacity_hint;
     cm->valuesz = valuesz;
-    cm->buckets = calloc(sizeof(void *) * cm->nbuckets, 1);
+    cm->buckets = map_alloc(allocator, sizeof(void *) * cm->nbuckets);
+    memset(cm->buckets, 0, sizeof(void *) * cm->nbuckets);
     cm->size = 0;
+    cm->cleanup = fn;
     return cm;
+}
 
+CMap *cmap_create(size_t valuesz, size_t capacity_hint, CleanupValueFn fn)
+{
+    return cmap_create_ex(NULL, valuesz, capacity_hint, fn);
 }
 
 void cmap_dispose(CMap *cm)
 {
-    //find all the cell pointers using cmap_next
-    void *cellptrs[cm->size];//array that contain pointers in each cell that will be freed
-    int cnt = 0; // 
-    for (const char *key = cmap_first(cm); key != NULL; key = cmap_next(cm, key)){
-        //ptr to next cell is the stored in 8 bytes before key pointer
-        void *cellptr = *(void **)((char *)key - sizeof(void *));
-        cellptrs[cnt++] = cellptr;
-    }
-    //free each cellptr
-    for (int i = 0; i < cnt; i++){
-        if (cellptrs[i] != NULL) free(cellptrs[i]);
-    }
-
-    //free each bucket
+    // walk each bucket's chain, cleaning up the value before freeing its cell
     for (int i = 0; i < cm->nbuckets; i++){
-        if (cm->buckets[i] != NULL)free(cm->buckets[i]);
+        void *cell = cm->buckets[i];
+        while (cell != NULL){
+            void *next = *(void **)cell;
+            const char *key = (char *)cell + sizeof(void *);
+            if (cm->cleanup != NULL) cm->cleanup((char *)key + strlen(key) + 1);
+            map_free(cm->allocator, cell, cell_size(key, cm->valuesz));
+            cell = next;
+        }
     }
-    //free cm->buckets
-    free(cm->buckets);
-    //finally free cm pointer
-    free(cm);
+    map_free(cm->allocator, cm->buckets, sizeof(void *) * cm->nbuckets);
+    map_free(cm->allocator, cm, sizeof(CMap));
 }
 
 
@@ -106,9 +131,11 @@ int cmap_count(const CMap *cm)
 }
 
 // return ptr to malloced cell
-void buildCell(void *firstCellptr, const char *key, const void* addr, size_t valuesz){
+void buildCell(const CMap *cm, void *firstCellptr, const char *key, const void* addr, size_t valuesz){
     // dereference firstCellptr to store pointer returned by malloc 
-    *(void **)firstCellptr = calloc(sizeof(void*) + strlen(key) + 1 + valuesz, 1);
+    CVM_COUNT(cells, 1);
+    size_t sz = cell_size(key, valuesz);
+    *(void **)firstCellptr = memset(map_alloc(cm->allocator, sz), 0, sz);
     // copy key
     strcpy(*(char **)firstCellptr + sizeof(void *), key);
     // copy value
@@ -124,12 +151,15 @@ int sameKey(void *cur, const char *keyProvided){
 
 void cmap_put(CMap *cm, const char *key, const void *addr)
 {
+    CVM_PROBE(CVM_CMAP_PUT);
     int idx = hash(key, cm->nbuckets); //index of the bucket
     void *head = &cm->buckets[idx];//ptr to head pointer of linkedlist
 
     while (*(void **)head != NULL){
+        CVM_COUNT(probes, 1);
         if (sameKey(*(void **)head, key) == 0){//update value for same key
             void *dest = (char *) *(void **)head + sizeof(void *) + strlen(key) + 1;
+            if (cm->cleanup != NULL) cm->cleanup(dest);
             memcpy(dest, addr, cm->valuesz);
             return; 
         }
@@ -137,18 +167,20 @@ void cmap_put(CMap *cm, const char *key, const void *addr)
     }
 
     // if key not found, append to end of linkedlist in that bucket
-    buildCell(head, key, addr, cm->valuesz);
+    buildCell(cm, head, key, addr, cm->valuesz);
     cm->size++;
 
 }
 
 void *cmap_get(const CMap *cm, const char *key)
 {
+    CVM_PROBE(CVM_CMAP_GET);
 
     int idx = hash(key, cm->nbuckets); //index of the bucket
     void *head = &cm->buckets[idx];///ptr to head pointer of linkedlist
 
     while (*(void **)head != NULL){
+        CVM_COUNT(probes, 1);
         if (sameKey(*(void **)head, key) == 0){
             void *valueptr = (char *) *(void **)head + sizeof(void *) + strlen(key) + 1;       
             return valueptr;
@@ -177,11 +209,13 @@ const char *cmap_first(const CMap *cm)
 
 const char *cmap_next(const CMap *cm, const char *prevkey)
 {
+    CVM_PROBE(CVM_CMAP_NEXT);
 
     int idx = hash(prevkey, cm->nbuckets); 
     void *head = &cm->buckets[idx];
 
     while (*(void **)head != NULL){
+        CVM_COUNT(probes, 1);
         if (sameKey(*(void **)head, prevkey) == 0){
             void *next = *(void **) *(void **)head;
             if (next != NULL){//there's still cell after cell with prevkey
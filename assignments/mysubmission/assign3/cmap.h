@@ -17,6 +17,7 @@
 #define _cmap_h
 
 #include <stddef.h>
+#include "callocator.h"
 
 
  /**
@@ -95,6 +96,21 @@ typedef struct CMapImplementation CMap;
 CMap *cmap_create(size_t valuesz, size_t capacity_hint, CleanupValueFn fn);
 
 
+/**
+ * Function: cmap_create_ex
+ * Usage: CMap *m = cmap_create_ex(&my_allocator, sizeof(int), 10, NULL)
+ * ---------------------------------------------------------------------
+ * Creates a new empty CMap whose memory all comes from the given
+ * CAllocator instead of malloc: the CMap struct, its buckets and the cell
+ * holding each entry. The other parameters have the same meaning as for
+ * cmap_create. The allocator must remain valid until the CMap is disposed.
+ *
+ * Asserts: zero valuesz, allocation failure
+ * Assumes: allocator is valid, cleanup fn is valid
+ */
+CMap *cmap_create_ex(const CAllocator *allocator, size_t valuesz, size_t capacity_hint, CleanupValueFn fn);
+
+
 /**
  * Function: cmap_dispose
  * Usage: cmap_dispose(m)
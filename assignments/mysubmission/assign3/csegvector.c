@@ -0,0 +1,243 @@
+/*
+ * File: csegvector.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * Segment k holds first << k elements, so with first = 2^shift, element i
+ * lives in the segment numbered by the highest set bit of i + first (less
+ * shift), at the offset given by the remaining low bits.
+ */
+#include <assert.h>
+#include "csegvector.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a suggested value to use when given capacity_hint is 0
+#define DEFAULT_CAPACITY 16
+
+// enough segments for INT_MAX elements even when the first segment holds 1
+#define MAX_SEGMENTS 32
+
+/* Type: struct CSegVectorImplementation
+ * -------------------------------------
+ * This definition completes the CSegVector type that was declared in
+ * csegvector.h.
+ */
+struct CSegVectorImplementation {
+    void *segs[MAX_SEGMENTS];// segment directory, segs[k] holds first << k elems
+    int nsegs;// number of segments allocated
+    unsigned shift;// log2 of the first segment's capacity
+    size_t capacity;// total elements the allocated segments can hold
+    size_t size;// count of elements stored
+    size_t elemsz;// size of individual elements in bytes
+    CleanupElemFn cleanup;// client function applied to elements being disposed
+};
+
+// capacity of segment k
+static inline size_t seg_len(const CSegVector *sv, int k)
+{
+    return (size_t)1 << (sv->shift + k);
+}
+
+// segment holding index i, and i's offset within it
+static inline int locate(const CSegVector *sv, size_t i, size_t *poff)
+{
+    size_t j = i + ((size_t)1 << sv->shift);
+    int top = 63 - __builtin_clzl(j);
+    *poff = j ^ ((size_t)1 << top);
+    return top - sv->shift;
+}
+
+// address of element i, with no check against size
+static inline char *elem_at(const CSegVector *sv, size_t i)
+{
+    size_t off;
+    int k = locate(sv, i, &off);
+    return (char *)sv->segs[k] + off * sv->elemsz;
+}
+
+// allocate the next segment, existing segments stay where they are
+static void add_segment(CSegVector *sv)
+{
+    assert(sv->nsegs < MAX_SEGMENTS);
+    size_t len = seg_len(sv, sv->nsegs);
+    sv->segs[sv->nsegs] = malloc(len * sv->elemsz);
+    assert(sv->segs[sv->nsegs] != NULL);
+    sv->nsegs++;
+    sv->capacity += len;
+}
+
+// move elements [index, size - 1) up one slot, size already counts the new slot
+static void shift_up(CSegVector *sv, size_t index)
+{
+    size_t sz = sv->elemsz;
+    size_t hi = sv->size - 1; // highest destination still to fill
+    while (hi > index){
+        size_t off;
+        int k = locate(sv, hi, &off);
+        size_t segstart = hi - off;
+        char *base = sv->segs[k];
+        if (index >= segstart){ // rest of the move is inside this segment
+            memmove(base + (index - segstart + 1) * sz, base + (index - segstart) * sz, (hi - index) * sz);
+            return;
+        }
+        memmove(base + sz, base, off * sz);
+        memcpy(base, elem_at(sv, segstart - 1), sz); // carry across the boundary
+        hi = segstart - 1;
+    }
+}
+
+// move elements [index + 1, size) down one slot, size not yet decremented
+static void shift_down(CSegVector *sv, size_t index)
+{
+    size_t sz = sv->elemsz;
+    size_t lo = index; // lowest destination still to fill
+    while (lo + 1 < sv->size){
+        size_t off;
+        int k = locate(sv, lo, &off);
+        size_t len = seg_len(sv, k), segend = lo - off + len;
+        char *base = sv->segs[k];
+        if (sv->size <= segend){ // rest of the move is inside this segment
+            memmove(base + off * sz, base + (off + 1) * sz, (sv->size - lo - 1) * sz);
+            return;
+        }
+        memmove(base + off * sz, base + (off + 1) * sz, (len - off - 1) * sz);
+        memcpy(base + (len - 1) * sz, sv->segs[k + 1], sz); // carry across the boundary
+        lo = segend;
+    }
+}
+
+CSegVector *csegvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+{
+    assert(elemsz > 0);
+    CSegVector *sv = malloc(sizeof(CSegVector));
+    assert(sv != NULL);
+    size_t first = capacity_hint == 0 ? DEFAULT_CAPACITY : capacity_hint;
+    sv->shift = 0;
+    while (((size_t)1 << sv->shift) < first && sv->shift < 30) sv->shift++;
+    sv->nsegs = 0;
+    sv->capacity = 0;
+    sv->size = 0;
+    sv->elemsz = elemsz;
+    sv->cleanup = fn;
+    return sv;
+}
+
+void csegvec_dispose(CSegVector *sv)
+{
+    if (sv->cleanup != NULL){
+        for (size_t i = 0; i < sv->size; i++) sv->cleanup(elem_at(sv, i));
+    }
+    for (int k = 0; k < sv->nsegs; k++) free(sv->segs[k]);
+    free(sv);
+}
+
+int csegvec_count(const CSegVector *sv)
+{
+    return (int)sv->size;
+}
+
+void *csegvec_nth(const CSegVector *sv, int index)
+{
+    assert(index >= 0 && index < sv->size);
+    return elem_at(sv, index);
+}
+
+void csegvec_append(CSegVector *sv, const void *addr)
+{
+    if (sv->size == sv->capacity) add_segment(sv);
+    memcpy(elem_at(sv, sv->size), addr, sv->elemsz);
+    sv->size++;
+}
+
+void csegvec_insert(CSegVector *sv, const void *addr, int index)
+{
+    assert(index >= 0 && index <= sv->size);
+    if (sv->size == sv->capacity) add_segment(sv);
+    sv->size++;
+    shift_up(sv, index);
+    memcpy(elem_at(sv, index), addr, sv->elemsz);
+}
+
+void csegvec_replace(CSegVector *sv, const void *addr, int index)
+{
+    void *elem = csegvec_nth(sv, index);
+    if (sv->cleanup != NULL) sv->cleanup(elem);
+    memcpy(elem, addr, sv->elemsz);
+}
+
+void csegvec_remove(CSegVector *sv, int index)
+{
+    void *elem = csegvec_nth(sv, index);
+    if (sv->cleanup != NULL) sv->cleanup(elem);
+    shift_down(sv, index);
+    sv->size--;
+}
+
+int csegvec_search(const CSegVector *sv, const void *keyaddr, CompareFn cmp, int start, bool sorted)
+{
+    assert(start >= 0 && start <= sv->size);
+    if (!sorted){
+        for (size_t i = start; i < sv->size; i++){
+            if (cmp(elem_at(sv, i), keyaddr) == 0) return (int)i;
+        }
+        return -1;
+    }
+    // binary search over [lo, hi), same contract as bsearch
+    size_t lo = start, hi = sv->size;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        int res = cmp(keyaddr, elem_at(sv, mid));
+        if (res == 0) return (int)mid;
+        if (res < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+void csegvec_sort(CSegVector *sv, CompareFn cmp)
+{
+    if (sv->size < 2) return;
+    if (sv->size <= seg_len(sv, 0)){ // everything is in the first segment
+        qsort(sv->segs[0], sv->size, sv->elemsz, cmp);
+        return;
+    }
+    // gather segment by segment into contiguous storage, sort, scatter back
+    char *tmp = malloc(sv->size * sv->elemsz);
+    assert(tmp != NULL);
+    size_t done = 0;
+    for (int k = 0; done < sv->size; k++){
+        size_t n = seg_len(sv, k) < sv->size - done ? seg_len(sv, k) : sv->size - done;
+        memcpy(tmp + done * sv->elemsz, sv->segs[k], n * sv->elemsz);
+        done += n;
+    }
+    qsort(tmp, sv->size, sv->elemsz, cmp);
+    done = 0;
+    for (int k = 0; done < sv->size; k++){
+        size_t n = seg_len(sv, k) < sv->size - done ? seg_len(sv, k) : sv->size - done;
+        memcpy(sv->segs[k], tmp + done * sv->elemsz, n * sv->elemsz);
+        done += n;
+    }
+    free(tmp);
+}
+
+void *csegvec_first(const CSegVector *sv)
+{
+    return sv->size == 0 ? NULL : sv->segs[0];
+}
+
+void *csegvec_next(const CSegVector *sv, const void *prev)
+{
+    uintptr_t p = (uintptr_t)prev;
+    // later segments are larger, so search from the last one down
+    for (int k = sv->nsegs - 1; k >= 0; k--){
+        uintptr_t base = (uintptr_t)sv->segs[k];
+        size_t len = seg_len(sv, k);
+        if (p < base || p >= base + len * sv->elemsz) continue;
+        size_t index = len - seg_len(sv, 0) + (p - base) / sv->elemsz;
+        if (index + 1 >= sv->size) return NULL;
+        if (p + sv->elemsz < base + len * sv->elemsz) return (char *)prev + sv->elemsz;
+        return sv->segs[k + 1];
+    }
+    return NULL;
+}
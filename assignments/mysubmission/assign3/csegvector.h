@@ -0,0 +1,146 @@
+/* File: csegvector.h
+ * ------------------
+ * Defines the interface for the CSegVector type.
+ *
+ * The CSegVector is a drop-in alternative to the CVector (see cvector.h)
+ * for clients that hold on to element pointers or that cannot tolerate the
+ * pause of copying a large vector when it grows. Elements are stored in a
+ * sequence of segments whose sizes are successive powers of two, tracked by
+ * a small fixed directory. Growing adds a new segment and never moves
+ * existing elements, so a pointer returned by csegvec_nth stays valid until
+ * that element is removed or the elements are rearranged (insert, remove,
+ * sort). Appends cost constant time in the worst case, not just amortized,
+ * and indexing stays constant-time by computing the segment from the
+ * highest set bit of the index.
+ *
+ * The functions mirror the CVector functions of the same name, with the
+ * same arguments, conventions and asserts, except where noted.
+ */
+
+#ifndef _csegvector_h
+#define _csegvector_h
+
+#include "cvector.h"	// CompareFn, CleanupElemFn
+
+/**
+ * Type: CSegVector
+ * ----------------
+ * Defines the CSegVector type. As for the CVector, the type is incomplete
+ * and clients only ever hold CSegVector* pointers.
+ */
+typedef struct CSegVectorImplementation CSegVector;
+
+
+/**
+ * Function: csegvec_create
+ * Usage: CSegVector *v = csegvec_create(sizeof(int), 10, NULL)
+ * ------------------------------------------------------------
+ * Creates a new empty CSegVector. The capacity_hint, rounded up to a power
+ * of two, is the size of the first segment; each further segment is twice
+ * the size of the previous one. If capacity_hint is 0, an internal default
+ * value is used. No storage is allocated until the first element is added.
+ *
+ * Asserts: zero elemsz, allocation failure
+ * Assumes: cleanup fn is valid
+ */
+CSegVector *csegvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
+
+
+/**
+ * Function: csegvec_dispose
+ * Usage: csegvec_dispose(v)
+ * -------------------------
+ * Calls the client's cleanup function on each element and deallocates all
+ * segments. Operates in linear-time.
+ */
+void csegvec_dispose(CSegVector *sv);
+
+
+/**
+ * Function: csegvec_count
+ * Usage: int count = csegvec_count(v)
+ * -----------------------------------
+ * Returns the number of elements stored. Operates in constant-time.
+ */
+int csegvec_count(const CSegVector *sv);
+
+
+/**
+ * Function: csegvec_nth
+ * Usage: int num = *(int *)csegvec_nth(v, 0)
+ * ------------------------------------------
+ * Returns a pointer to the element at the given index. Unlike cvec_nth,
+ * the pointer is not invalidated by appends. Operates in constant-time.
+ *
+ * Asserts: invalid index
+ */
+void *csegvec_nth(const CSegVector *sv, int index);
+
+
+/**
+ * Functions: csegvec_append, csegvec_insert
+ * Usage: csegvec_append(v, &elem)
+ *        csegvec_insert(v, &elem, 0)
+ * ----------------------------------
+ * Add a copy of the element at addr to the end, or at the given index
+ * shifting up later elements. Appending operates in constant-time (worst
+ * case, a new segment is allocated but nothing is copied). Inserting
+ * operates in linear-time.
+ *
+ * Asserts: invalid index, allocation failure
+ * Assumes: address of valid elem
+ */
+void csegvec_append(CSegVector *sv, const void *addr);
+void csegvec_insert(CSegVector *sv, const void *addr, int index);
+
+
+/**
+ * Functions: csegvec_replace, csegvec_remove
+ * Usage: csegvec_replace(v, &elem, 0)
+ *        csegvec_remove(v, 0)
+ * ----------------------------------
+ * Overwrite the element at index, or remove it shifting down later
+ * elements. The client's cleanup function is called on the element being
+ * replaced/removed. Replacing operates in constant-time, removing in
+ * linear-time. Segments are kept when elements are removed.
+ *
+ * Asserts: invalid index
+ * Assumes: address of valid elem
+ */
+void csegvec_replace(CSegVector *sv, const void *addr, int index);
+void csegvec_remove(CSegVector *sv, int index);
+
+
+/**
+ * Functions: csegvec_search, csegvec_sort
+ * Usage: int found = csegvec_search(v, &key, cmp_int, 0, false)
+ *        csegvec_sort(v, cmp_int)
+ * -------------------------------------------------------------
+ * Search for an element matching the key (linear, or binary if sorted is
+ * true) and sort elements into ascending order, exactly as cvec_search and
+ * cvec_sort do. Sorting copies elements into temporary contiguous storage
+ * and back, so it uses memory proportional to the size of the CSegVector.
+ *
+ * Asserts: invalid start index, allocation failure
+ * Assumes: address of valid key, cmp fn is valid
+ */
+int csegvec_search(const CSegVector *sv, const void *keyaddr, CompareFn cmp, int start, bool sorted);
+void csegvec_sort(CSegVector *sv, CompareFn cmp);
+
+
+/**
+ * Functions: csegvec_first, csegvec_next
+ * Usage: for (void *cur = csegvec_first(v); cur != NULL; cur = csegvec_next(v, cur))
+ * ----------------------------------------------------------------------------------
+ * Iterate over the elements in order of increasing index, as cvec_first and
+ * cvec_next do. csegvec_next must locate the segment holding prev, which
+ * takes time logarithmic in the number of segments in the worst case and
+ * typically one or two checks, since the largest segment holds half of
+ * the elements.
+ *
+ * Assumes: address of prev is valid
+ */
+void *csegvec_first(const CSegVector *sv);
+void *csegvec_next(const CSegVector *sv, const void *prev);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * File: cstrvec.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * String bytes live in a CVector of char, offsets in a CVector of uint32_t.
+ * Offsets are always ascending: appends add to the end and sort repacks,
+ * so the string after one at index i starts right after its terminator.
+ */
+#define _GNU_SOURCE // qsort_r
+#include <assert.h>
+#include "cstrvec.h"
+#include "cvector.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// suggested values to use when given hints are 0
+#define DEFAULT_CAPACITY 16
+#define DEFAULT_BYTES 1024
+
+/* Type: struct CStrVecImplementation
+ * ----------------------------------
+ * This definition completes the CStrVec type that was declared in
+ * cstrvec.h.
+ */
+struct CStrVecImplementation {
+    CVector *bytes;// all strings with their terminators, end to end
+    CVector *offsets;// uint32_t offset of each string into bytes
+};
+
+// what the qsort_r comparison needs to get from offsets to strings
+typedef struct {
+    const char *base;
+    StrCompareFn cmp;
+} sortContext;
+
+static int cmp_offsets(const void *addr1, const void *addr2, void *data)
+{
+    const sortContext *ctx = data;
+    return ctx->cmp(ctx->base + *(const uint32_t *)addr1, ctx->base + *(const uint32_t *)addr2);
+}
+
+CStrVec *cstrvec_create(size_t capacity_hint, size_t bytes_hint)
+{
+    CStrVec *sv = malloc(sizeof(CStrVec));
+    assert(sv != NULL);
+    sv->bytes = cvec_create(1, bytes_hint == 0 ? DEFAULT_BYTES : bytes_hint, NULL);
+    sv->offsets = cvec_create(sizeof(uint32_t), capacity_hint == 0 ? DEFAULT_CAPACITY : capacity_hint, NULL);
+    return sv;
+}
+
+void cstrvec_dispose(CStrVec *sv)
+{
+    cvec_dispose(sv->bytes);
+    cvec_dispose(sv->offsets);
+    free(sv);
+}
+
+int cstrvec_count(const CStrVec *sv)
+{
+    return cvec_count(sv->offsets);
+}
+
+const char *cstrvec_nth(const CStrVec *sv, int index)
+{
+    uint32_t offset = *(uint32_t *)cvec_nth(sv->offsets, index);
+    return cvec_nth(sv->bytes, offset);
+}
+
+void cstrvec_append(CStrVec *sv, const char *s)
+{
+    size_t len = strlen(s) + 1, offset = cvec_count(sv->bytes);
+    assert(offset + len <= INT_MAX); // cvec_nth takes an int index into bytes
+    uint32_t off32 = offset;
+    cvec_append_n(sv->bytes, s, len);
+    cvec_append(sv->offsets, &off32);
+}
+
+void cstrvec_sort(CStrVec *sv, StrCompareFn cmp)
+{
+    int n = cvec_count(sv->offsets);
+    if (n < 2) return;
+    sortContext ctx = {cvec_nth(sv->bytes, 0), cmp};
+    qsort_r(cvec_nth(sv->offsets, 0), n, sizeof(uint32_t), cmp_offsets, &ctx);
+    // repack the bytes in sorted order so offsets ascend again
+    CVector *packed = cvec_create(1, cvec_count(sv->bytes), NULL);
+    for (int i = 0; i < n; i++){
+        uint32_t *poffset = cvec_nth(sv->offsets, i);
+        const char *s = ctx.base + *poffset;
+        *poffset = cvec_count(packed);
+        cvec_append_n(packed, s, strlen(s) + 1);
+    }
+    cvec_dispose(sv->bytes);
+    sv->bytes = packed;
+}
+
+const char *cstrvec_first(const CStrVec *sv)
+{
+    return cvec_count(sv->offsets) == 0 ? NULL : cvec_nth(sv->bytes, 0);
+}
+
+const char *cstrvec_next(const CStrVec *sv, const char *prev)
+{
+    const char *next = prev + strlen(prev) + 1;
+    const char *end = (const char *)cvec_nth(sv->bytes, 0) + cvec_count(sv->bytes);
+    return next < end ? next : NULL;
+}
@@ -0,0 +1,130 @@
+/* File: cstrvec.h
+ * ---------------
+ * Defines the interface for the CStrVec type.
+ *
+ * The CStrVec is a vector of strings that stores the string bytes itself,
+ * packed end to end in one growable block, with an array of offsets to
+ * find each string. Compared with a CVector of strdup'ed char * elements
+ * there is no allocation per string, no per-string malloc overhead, and
+ * strings read in order sit next to each other in memory. Disposing is a
+ * couple of frees regardless of the number of strings.
+ *
+ * Strings are copied in when appended and are never modified in place.
+ * The bytes are held in a CVector, which counts with int, so the total
+ * bytes stored (including each string's null terminator) are limited to
+ * 2GB, which also keeps the 32-bit offsets in range.
+ */
+
+#ifndef _cstrvec_h
+#define _cstrvec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Type: CStrVec
+ * -------------
+ * Defines the CStrVec type. The type is incomplete and clients only ever
+ * hold CStrVec* pointers.
+ */
+typedef struct CStrVecImplementation CStrVec;
+
+/**
+ * Type: StrCompareFn
+ * ------------------
+ * Compares two strings the way strcmp does, returning <0, 0 or >0. strcmp
+ * itself can be passed wherever a StrCompareFn is expected.
+ */
+typedef int (*StrCompareFn)(const char *s1, const char *s2);
+
+
+/**
+ * Function: cstrvec_create
+ * Usage: CStrVec *sv = cstrvec_create(1000, 0)
+ * --------------------------------------------
+ * Creates a new empty CStrVec with room for capacity_hint strings and
+ * bytes_hint bytes of string data. Either hint may be 0 for an internal
+ * default.
+ *
+ * Asserts: allocation failure
+ */
+CStrVec *cstrvec_create(size_t capacity_hint, size_t bytes_hint);
+
+
+/**
+ * Function: cstrvec_dispose
+ * Usage: cstrvec_dispose(sv)
+ * --------------------------
+ * Deallocates the CStrVec and all of its strings. Operates in
+ * constant-time.
+ */
+void cstrvec_dispose(CStrVec *sv);
+
+
+/**
+ * Function: cstrvec_count
+ * Usage: int count = cstrvec_count(sv)
+ * ------------------------------------
+ * Returns the number of strings stored. Operates in constant-time.
+ */
+int cstrvec_count(const CStrVec *sv);
+
+
+/**
+ * Function: cstrvec_nth
+ * Usage: const char *s = cstrvec_nth(sv, 0)
+ * -----------------------------------------
+ * Returns the string at the given index. The pointer is into the CStrVec's
+ * own storage and is invalidated by any append or sort; copy the string if
+ * it needs to outlive those. Operates in constant-time.
+ *
+ * Asserts: invalid index
+ */
+const char *cstrvec_nth(const CStrVec *sv, int index);
+
+
+/**
+ * Function: cstrvec_append
+ * Usage: cstrvec_append(sv, path)
+ * -------------------------------
+ * Copies the string s to the end of the CStrVec. Operates in amortized
+ * time proportional to the length of s.
+ *
+ * Asserts: allocation failure, total bytes over 2GB
+ * Assumes: s is a valid string
+ */
+void cstrvec_append(CStrVec *sv, const char *s);
+
+
+/**
+ * Function: cstrvec_sort
+ * Usage: cstrvec_sort(sv, strcmp)
+ * -------------------------------
+ * Sorts the strings into ascending order according to cmp. The sort
+ * permutes only the offsets, with cmp reading the string bytes in place,
+ * then repacks the bytes in the new order with one linear pass so that
+ * iteration stays sequential in memory. The repacked bytes go into a new
+ * block before the old one is freed, so peak memory for the bytes is
+ * twice their size.
+ *
+ * Asserts: allocation failure
+ * Assumes: cmp fn is valid
+ */
+void cstrvec_sort(CStrVec *sv, StrCompareFn cmp);
+
+
+/**
+ * Functions: cstrvec_first, cstrvec_next
+ * Usage: for (const char *s = cstrvec_first(sv); s != NULL; s = cstrvec_next(sv, s))
+ * ----------------------------------------------------------------------------------
+ * Iterate over the strings in order of increasing index, as cvec_first and
+ * cvec_next do for a CVector. The client must not append or sort in the
+ * midst of iterating. Each step operates in time proportional to the
+ * length of the previous string.
+ *
+ * Assumes: prev is a string returned by cstrvec_first/cstrvec_next
+ */
+const char *cstrvec_first(const CStrVec *sv);
+const char *cstrvec_next(const CStrVec *sv, const char *prev);
+
+#endif
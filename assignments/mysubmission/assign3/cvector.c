@@ -4,28 +4,109 @@
  * ----------------------
  *
  */
+#define _GNU_SOURCE // mremap
 #include <assert.h>
 #include "cvector.h"
+#include "cvector_template.h"
+#include "cvmstats.h"
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // a suggested value to use when given capacity_hint is 0
 #define DEFAULT_CAPACITY 16
 
+// bytes of element storage kept inside the CVector struct itself. Small
+// vectors live entirely in this buffer and never allocate separate storage
+#ifndef CVEC_INLINE_BYTES
+#define CVEC_INLINE_BYTES 64
+#endif
+
+// default factor capacity is multiplied by when a CVector fills up
+#define DEFAULT_GROWTH 2.0
+
+// storage at least this large is moved from malloc to an anonymous mapping
+// advised to use transparent huge pages, which cuts TLB misses on big vectors
+#ifndef CVEC_HUGE_THRESHOLD
+#define CVEC_HUGE_THRESHOLD (32UL << 20)
+#endif
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+// identifies a file written by cvec_open_mapped or cvec_write, "CVEC" read little-endian
+#define CVEC_MAGIC 0x43455643
+#define CVEC_FILE_VERSION 1
+
+// cvec_file_header flags
+#define CVEC_FILE_CHECKSUM   0x1   // checksum field covers the payload
+#define CVEC_FILE_SERIALIZED 0x2   // payload is encoded by a CVecSerializer, not raw elements
+
+// bytes of storage cvec_read sets aside at a time for data it has not yet
+// seen, so a lying header on a pipe cannot make it allocate far ahead of
+// what actually arrives
+#define CVEC_READ_CHUNK (1UL << 20)
+
+/* Type: struct cvec_file_header
+ * -----------------------------
+ * Layout of the start of a CVector file. Raw elements follow immediately
+ * after the header, so a file is mapped and used as-is with no parsing.
+ * The file length beyond the header gives the capacity. Fields after count
+ * were reserved zeros in files from before cvec_write, which read as raw
+ * with no checksum.
+ */
+struct cvec_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t elemsz;
+    uint64_t count;        // number of elements in use, written at dispose
+    uint64_t checksum;     // of the payload, if CVEC_FILE_CHECKSUM is set
+    uint64_t payload;      // bytes of encoded elements, if CVEC_FILE_SERIALIZED
+    uint32_t flags;
+    char reserved[20];     // pads elements out to a 64-byte offset
+};
+_Static_assert(sizeof(struct cvec_file_header) == 64, "elements must start 64 bytes into the file");
+
 /* Type: struct CVectorImplementation
  * ----------------------------------
  * This definition completes the CVector type that was declared in
- * cvector.h. You fill in the struct with your chosen fields.
+ * cvector.h. You fill in the struct with your chosen fields. The first
+ * four fields are shared with typed vectors and must stay in this order.
  */
 struct CVectorImplementation {
     void *elems; //store pointer to the first element
     size_t nelems;//capacity of the  Cvector
     size_t elemsz;//size of individual elements in bytes
     size_t size;// count of current elemtns stored in Cvector
+    size_t hint;// capacity to allocate when spilling out of inline storage
+    CleanupElemFn cleanup;// client function applied to elements being disposed
+    CArena *arena;// arena owning this CVector's memory, NULL if on the heap
+    const CAllocator *allocator;// source of heap memory, NULL for malloc
+    struct cvec_file_header *mapped;// start of mapped file, NULL if not file-backed
+    int fd;// descriptor of the mapped file
+    unsigned slack;// bytes before this struct in its allocator block
+    size_t hugelen;// bytes mapped for huge-page storage, 0 if not in use
+    size_t huge_threshold;// storage bytes at which to switch to huge pages, 0 never
+    double growth;// factor capacity is multiplied by when full
+    char inline_elems[CVEC_INLINE_BYTES] __attribute__((aligned(16)));// small buffer
 };
 
+// typed vectors from cvector_template.h access these fields directly
+_Static_assert(offsetof(struct CVectorImplementation, elems) == offsetof(struct cvec_layout, elems)
+               && offsetof(struct CVectorImplementation, nelems) == offsetof(struct cvec_layout, nelems)
+               && offsetof(struct CVectorImplementation, elemsz) == offsetof(struct cvec_layout, elemsz)
+               && offsetof(struct CVectorImplementation, size) == offsetof(struct cvec_layout, size),
+               "CVector must begin with the fields of struct cvec_layout");
+
 
 
 
@@ -40,21 +121,275 @@ struct CVectorImplementation {
 #define NOT_YET_IMPLEMENTED printf("%s() not yet implemented!\n", __func__); raise(SIGKILL); exit(107);
 
 
-CVector *cvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+// round sz up to a multiple of mult, which must be a power of 2
+static inline size_t roundup(size_t sz, size_t mult)
 {
-    CVector *cv = malloc(sizeof(CVector));
-    cv->nelems = capacity_hint <= 0 ? DEFAULT_CAPACITY : capacity_hint;// CVector capacity
-    cv->elems = malloc(sizeof(elemsz)*cv->nelems);//points to 0th elem in array always
+    return (sz + mult - 1) & ~(mult - 1);
+}
+
+// true if elements are still stored in the small buffer inside the struct
+static inline bool is_inline(const CVector *cv)
+{
+    return cv->elems == cv->inline_elems;
+}
+
+// heap memory comes from the client's allocator if the CVector has one
+static inline void *heap_alloc(const CAllocator *allocator, size_t nbytes)
+{
+    return allocator ? allocator->alloc(allocator->context, nbytes) : malloc(nbytes);
+}
+
+static inline void *heap_realloc(const CAllocator *allocator, void *ptr, size_t oldbytes, size_t nbytes)
+{
+    return allocator ? allocator->realloc(allocator->context, ptr, oldbytes, nbytes) : realloc(ptr, nbytes);
+}
+
+static inline void heap_free(const CAllocator *allocator, void *ptr, size_t nbytes)
+{
+    if (allocator) allocator->free(allocator->context, ptr, nbytes);
+    else free(ptr);
+}
+
+// release heap or huge-page storage (not inline, arena or file storage)
+static void free_elems(CVector *cv)
+{
+    if (cv->hugelen != 0) munmap(cv->elems, cv->hugelen);
+    else if (!is_inline(cv)) heap_free(cv->allocator, cv->elems, cv->nelems * cv->elemsz);
+    cv->hugelen = 0;
+}
+
+// allocate element storage from the arena if the CVector has one
+static void *alloc_elems(CVector *cv, size_t nbytes)
+{
+    void *elems = cv->arena ? carena_alloc(cv->arena, nbytes) : heap_alloc(cv->allocator, nbytes);
+    assert(elems != NULL);
+    return elems;
+}
+
+// fill in a freshly allocated CVector struct, leaving it without element
+// storage for callers (such as file mappings) that supply their own
+static void init_fields(CVector *cv, size_t elemsz, size_t capacity_hint, CleanupElemFn fn, CArena *arena, const CAllocator *allocator)
+{
+    assert(elemsz > 0);
     cv->elemsz = elemsz;// element size in byte
     cv->size = 0;// CVector size
+    cv->hint = capacity_hint <= 0 ? DEFAULT_CAPACITY : capacity_hint;
+    cv->cleanup = fn;
+    cv->arena = arena;
+    cv->allocator = allocator;
+    cv->slack = 0;
+    cv->mapped = NULL;
+    cv->fd = -1;
+    cv->hugelen = 0;
+    // a client allocator is used for all storage unless huge pages are asked for
+    cv->huge_threshold = allocator == NULL ? CVEC_HUGE_THRESHOLD : 0;
+    cv->growth = DEFAULT_GROWTH;
+    cv->elems = NULL;
+    cv->nelems = 0;
+}
+
+// fill in a freshly allocated CVector struct and give it element storage
+static void init_cvec(CVector *cv, size_t elemsz, size_t capacity_hint, CleanupElemFn fn, CArena *arena, const CAllocator *allocator)
+{
+    init_fields(cv, elemsz, capacity_hint, fn, arena, allocator);
+    if (elemsz <= CVEC_INLINE_BYTES){
+        // start in the small buffer, hint sizes the first heap allocation
+        cv->elems = cv->inline_elems;
+        cv->nelems = CVEC_INLINE_BYTES / elemsz;
+    }else{
+        cv->nelems = cv->hint;// CVector capacity
+        cv->elems = alloc_elems(cv, elemsz * cv->nelems);//points to 0th elem in array always
+    }
+}
+
+// apply client cleanup to every element, leaving the CVector empty
+static void cleanup_elems(CVector *cv)
+{
+    if (cv->cleanup != NULL){
+        for (size_t i = 0; i < cv->size; i++)
+            cv->cleanup((char *)cv->elems + i * cv->elemsz);
+    }
+    cv->size = 0;
+}
+
+// deferred action registered with the arena for arena-backed CVectors
+static void cleanup_in_arena(void *data)
+{
+    cleanup_elems((CVector *)data);
+}
+
+CVector *cvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+{
+    CVector *cv = malloc(sizeof(CVector));
+    assert(cv != NULL);
+    init_cvec(cv, elemsz, capacity_hint, fn, NULL, NULL);
     return cv;
 
 };
 
+CVector *cvec_create_in(CArena *arena, size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+{
+    CVector *cv = carena_alloc(arena, sizeof(CVector));
+    // register before any storage is allocated so the storage stays the
+    // arena's most recent allocation and can grow in place
+    if (fn != NULL) carena_defer(arena, cleanup_in_arena, cv);
+    init_cvec(cv, elemsz, capacity_hint, fn, arena, NULL);
+    return cv;
+}
+
+// the struct needs 16-byte alignment for its inline buffer, which a client
+// allocator may not give (mymalloc aligns to 8), so leave room to align it
+#define STRUCT_BLOCK (sizeof(CVector) + __alignof__(CVector) - 8)
+
+CVector *cvec_create_ex(const CAllocator *allocator, size_t elemsz, size_t capacity_hint, CleanupElemFn fn)
+{
+    char *block = heap_alloc(allocator, STRUCT_BLOCK);
+    assert(block != NULL);
+    CVector *cv = (CVector *)roundup((uintptr_t)block, __alignof__(CVector));
+    init_cvec(cv, elemsz, capacity_hint, fn, NULL, allocator);
+    cv->slack = (char *)cv - block;
+    return cv;
+}
+
+static void *malloc_alloc(void *context, size_t size)
+{
+    return malloc(size);
+}
+
+static void *malloc_realloc(void *context, void *ptr, size_t oldsize, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void malloc_free(void *context, void *ptr, size_t size)
+{
+    free(ptr);
+}
+
+const CAllocator callocator_malloc = {malloc_alloc, malloc_realloc, malloc_free, NULL};
+
+// bytes of file needed to hold a header plus nelems elements
+static inline size_t mapped_length(const CVector *cv, size_t nelems)
+{
+    return sizeof(struct cvec_file_header) + nelems * cv->elemsz;
+}
+
+// map the open file into cv, writing a header if the file is empty.
+// Returns false if the file is not a CVector file with the right elemsz
+static bool map_file(CVector *cv, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1) return false;
+    bool created = (st.st_size == 0);
+    if (created){ // new file, size it for the default capacity
+        cv->nelems = DEFAULT_CAPACITY;
+        if (ftruncate(fd, mapped_length(cv, cv->nelems)) == -1) return false;
+    }else if (st.st_size < sizeof(struct cvec_file_header)){
+        return false;
+    }else{
+        cv->nelems = (st.st_size - sizeof(struct cvec_file_header)) / cv->elemsz;
+    }
+    struct cvec_file_header *header = mmap(NULL, mapped_length(cv, cv->nelems),
+                                           PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) return false;
+
+    if (created){
+        *header = (struct cvec_file_header){.magic = CVEC_MAGIC, .version = CVEC_FILE_VERSION, .elemsz = cv->elemsz};
+    }else if (header->magic != CVEC_MAGIC || header->version != CVEC_FILE_VERSION ||
+              header->elemsz != cv->elemsz || header->count > cv->nelems ||
+              (header->flags & CVEC_FILE_SERIALIZED)){
+        munmap(header, mapped_length(cv, cv->nelems));
+        return false;
+    }
+    cv->mapped = header;
+    cv->fd = fd;
+    cv->size = header->count;
+    cv->elems = header + 1; // elements are used in place, no parsing
+    return true;
+}
+
+CVector *cvec_open_mapped(const char *path, size_t elemsz)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) return NULL;
+    CVector *cv = malloc(sizeof(CVector));
+    assert(cv != NULL);
+    init_fields(cv, elemsz, 0, NULL, NULL, NULL); // the file is the storage
+    if (!map_file(cv, fd)){
+        close(fd);
+        free(cv);
+        return NULL;
+    }
+    return cv;
+}
+
+// record the count and trim unused capacity from the file, then unmap it.
+// A read-only view (no fd) is just unmapped
+static void close_mapped(CVector *cv)
+{
+    if (cv->fd == -1){
+        munmap(cv->mapped, mapped_length(cv, cv->nelems));
+        return;
+    }
+    cv->mapped->count = cv->size;
+    cv->mapped->flags &= ~CVEC_FILE_CHECKSUM; // elements may have changed
+    munmap(cv->mapped, mapped_length(cv, cv->nelems));
+    ftruncate(cv->fd, mapped_length(cv, cv->size));
+    close(cv->fd);
+}
+
+CVector *cvec_view_mapped(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+    struct stat st;
+    struct cvec_file_header header;
+    CVector *cv = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == CVEC_MAGIC && header.version == CVEC_FILE_VERSION && header.elemsz > 0 &&
+        !(header.flags & CVEC_FILE_SERIALIZED) &&
+        header.count <= (st.st_size - sizeof(header)) / header.elemsz){
+        cv = malloc(sizeof(CVector));
+        assert(cv != NULL);
+        init_fields(cv, header.elemsz, 0, NULL, NULL, NULL); // the file is the storage
+        cv->nelems = header.count;
+        cv->mapped = mmap(NULL, mapped_length(cv, cv->nelems), PROT_READ, MAP_SHARED, fd, 0);
+        if (cv->mapped == MAP_FAILED){
+            free(cv);
+            cv = NULL;
+        }else{
+            cv->size = header.count;
+            cv->elems = cv->mapped + 1;
+        }
+    }
+    close(fd); // the mapping stays valid without the descriptor
+    return cv;
+}
+
+void cvec_advise(CVector *cv, CVecAdvice advice)
+{
+    if (cv->mapped == NULL) return;
+    static const int madv[] = {
+        [CVEC_ADVICE_NORMAL] = MADV_NORMAL,
+        [CVEC_ADVICE_SEQUENTIAL] = MADV_SEQUENTIAL,
+        [CVEC_ADVICE_RANDOM] = MADV_RANDOM,
+    };
+    madvise(cv->mapped, mapped_length(cv, cv->nelems), madv[advice]);
+}
+
 void cvec_dispose(CVector *cv)
 {
-    free(cv->elems);
-    free(cv);
+    if (cv->mapped != NULL){ // elements persist in the file, no cleanup
+        close_mapped(cv);
+        free(cv);
+        return;
+    }
+    cleanup_elems(cv);
+    if (cv->arena != NULL) return; // memory goes away with the arena
+    free_elems(cv);
+    if (cv->allocator != NULL) heap_free(cv->allocator, (char *)cv - cv->slack, STRUCT_BLOCK);
+    else free(cv);
 }
 
 int cvec_count(const CVector *cv)
@@ -69,61 +404,194 @@ void *cvec_nth(const CVector *cv, int index)
     return nth;
 }
 
+// move heap storage into (or resize) an anonymous mapping backed by huge
+// pages. mremap lets the kernel move page tables instead of copying bytes
+static void set_huge_capacity(CVector *cv, size_t nbytes)
+{
+    size_t len = roundup(nbytes, HUGE_PAGE_SIZE);
+    void *elems;
+    if (cv->hugelen != 0){
+        elems = mremap(cv->elems, cv->hugelen, len, MREMAP_MAYMOVE);
+        assert(elems != MAP_FAILED);
+    }else{
+        elems = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(elems != MAP_FAILED);
+        memcpy(elems, cv->elems, cv->size * cv->elemsz);
+        CVM_COUNT(move_bytes, cv->size * cv->elemsz);
+        free_elems(cv);
+    }
+    madvise(elems, len, MADV_HUGEPAGE);
+    cv->elems = elems;
+    cv->hugelen = len;
+}
+
+// move element storage to a new capacity, which must hold all current elements
+static void set_capacity(CVector *cv, size_t nelems)
+{
+    size_t nbytes = nelems * cv->elemsz;
+    CVM_COUNT(moves, 1);
+    if (cv->mapped != NULL){ // resize the file, then remap it
+        int err = ftruncate(cv->fd, mapped_length(cv, nelems));
+        assert(err == 0);
+        cv->mapped = mremap(cv->mapped, mapped_length(cv, cv->nelems), mapped_length(cv, nelems), MREMAP_MAYMOVE);
+        assert(cv->mapped != MAP_FAILED);
+        cv->elems = cv->mapped + 1;
+    }else if (cv->arena != NULL){ // arena storage can grow but never shrinks
+        if (is_inline(cv)){
+            void *elems = alloc_elems(cv, nbytes);
+            memcpy(elems, cv->inline_elems, cv->size * cv->elemsz);
+            CVM_COUNT(move_bytes, cv->size * cv->elemsz);
+            cv->elems = elems;
+        }else{
+            void *old = cv->elems;
+            cv->elems = carena_grow(cv->arena, cv->elems, cv->nelems * cv->elemsz, nbytes);
+            CVM_COUNT(move_bytes, cv->elems != old ? cv->nelems * cv->elemsz : 0);
+        }
+    }else if (cv->huge_threshold != 0 && nbytes >= cv->huge_threshold){
+        set_huge_capacity(cv, nbytes);
+    }else if (nbytes <= CVEC_INLINE_BYTES){ // shrunk enough to move back inline
+        if (!is_inline(cv)){
+            memcpy(cv->inline_elems, cv->elems, cv->size * cv->elemsz);
+            CVM_COUNT(move_bytes, cv->size * cv->elemsz);
+            free_elems(cv);
+            cv->elems = cv->inline_elems;
+        }
+        nelems = CVEC_INLINE_BYTES / cv->elemsz;
+    }else if (is_inline(cv) || cv->hugelen != 0){ // copy out to the heap
+        void *elems = heap_alloc(cv->allocator, nbytes);
+        assert(elems != NULL);
+        memcpy(elems, cv->elems, cv->size * cv->elemsz);
+        CVM_COUNT(move_bytes, cv->size * cv->elemsz);
+        free_elems(cv);
+        cv->elems = elems;
+    }else{
+        void *old = cv->elems;
+        cv->elems = heap_realloc(cv->allocator, cv->elems, cv->nelems * cv->elemsz, nbytes);
+        assert(cv->elems != NULL);
+        // realloc copies the whole old block (or as much as fits) when it cannot resize in place
+        CVM_COUNT(move_bytes, cv->elems != old ? (nelems < cv->nelems ? nelems : cv->nelems) * cv->elemsz : 0);
+    }
+    cv->nelems = nelems;
+}
+
+// make room for at least nelems elements, growing geometrically so that
+// repeated appends stay amortized constant-time
+static void ensure_capacity(CVector *cv, size_t nelems)
+{
+    if (nelems <= cv->nelems) return;
+    size_t grown = cv->nelems * cv->growth;
+    // first spill goes straight to the client's hinted capacity
+    if (is_inline(cv) && cv->hint > grown) grown = cv->hint;
+    set_capacity(cv, grown > nelems ? grown : nelems);
+}
+
 void doubleCap(CVector *cv){
     // if CVector is filled, double the capacity
-    if (cv->size == cv->nelems){
-        cv->elems = realloc(cv->elems,(size_t) 2 * cv->nelems * cv->elemsz);
-        cv->nelems = 2 * cv->nelems;
-    } 
+    if (cv->size == cv->nelems) ensure_capacity(cv, cv->size + 1);
+}
 
+void cvec_reserve(CVector *cv, size_t nelems)
+{
+    if (nelems > cv->nelems) set_capacity(cv, nelems);
 }
+
+void cvec_shrink_to_fit(CVector *cv)
+{
+    if (cv->nelems > cv->size) set_capacity(cv, cv->size);
+}
+
+void cvec_set_growth(CVector *cv, double factor, size_t huge_threshold)
+{
+    assert(factor > 1.0);
+    cv->growth = factor;
+    cv->huge_threshold = huge_threshold;
+}
+
 void cvec_insert(CVector *cv, const void *addr, int index)
 {
-    assert(index >= 0 && index <= cv->size);
-    doubleCap(cv);
-    // address of new element after insertion
-    void *dest = (char *) cv->elems + index * cv->elemsz;
-
-    // move old elemes to the right
-    if (index <= cv->size - 1){
-        void *destPlusOne = (char *)dest + cv->elemsz;
-        int bitsToMove = cv->elemsz * (cv->size - index); // bits need to move to the right
-        char tmp[bitsToMove];//tmp char array to hold old value
-        memcpy(tmp, dest, bitsToMove);//copy old bits to tmp
-        memcpy(destPlusOne, tmp, bitsToMove);//copy from tmp to right of original idx
-    }
-    // insert new element
-    memcpy(dest, addr, cv->elemsz);
-    cv->size++;
+    cvec_insert_range(cv, addr, 1, index);
 }
 
 void cvec_append(CVector *cv, const void *addr)
 {
-    cvec_insert(cv, addr, cv->size);
+    CVM_PROBE(CVM_CVEC_APPEND);
+    doubleCap(cv);
+    memcpy((char *)cv->elems + cv->size * cv->elemsz, addr, cv->elemsz);
+    cv->size++;
 }
 
+void cvec_append_n(CVector *cv, const void *addr, size_t n)
+{
+    ensure_capacity(cv, cv->size + n);
+    memcpy((char *)cv->elems + cv->size * cv->elemsz, addr, n * cv->elemsz);
+    cv->size += n;
+}
 
+void cvec_insert_range(CVector *cv, const void *addr, size_t n, int index)
+{
+    CVM_PROBE(CVM_CVEC_INSERT_RANGE);
+    assert(index >= 0 && index <= cv->size);
+    ensure_capacity(cv, cv->size + n);
+    char *dest = (char *)cv->elems + index * cv->elemsz;
+    // shift the tail right in one move, then copy the new elements in
+    memmove(dest + n * cv->elemsz, dest, (cv->size - index) * cv->elemsz);
+    CVM_COUNT(shifts, 1);
+    CVM_COUNT(shift_bytes, (cv->size - index) * cv->elemsz);
+    memcpy(dest, addr, n * cv->elemsz);
+    cv->size += n;
+}
 
 void cvec_replace(CVector *cv, const void *addr, int index)
-{}//not required for sp17
+{
+    void *dest = cvec_nth(cv, index);
+    if (cv->cleanup != NULL) cv->cleanup(dest);
+    memcpy(dest, addr, cv->elemsz);
+}
 
 void cvec_remove(CVector *cv, int index)
-{}//not required for sp17
+{
+    cvec_remove_range(cv, index, 1);
+}
+
+void cvec_remove_range(CVector *cv, int index, size_t n)
+{
+    CVM_PROBE(CVM_CVEC_REMOVE_RANGE);
+    assert(index >= 0 && index + n <= cv->size);
+    char *dest = (char *)cv->elems + index * cv->elemsz;
+    if (cv->cleanup != NULL){
+        for (size_t i = 0; i < n; i++) cv->cleanup(dest + i * cv->elemsz);
+    }
+    // close the gap by shifting the tail left in one move
+    memmove(dest, dest + n * cv->elemsz, (cv->size - index - n) * cv->elemsz);
+    CVM_COUNT(shifts, 1);
+    CVM_COUNT(shift_bytes, (cv->size - index - n) * cv->elemsz);
+    cv->size -= n;
+}
+
+void cvec_swap_remove(CVector *cv, int index)
+{
+    void *dest = cvec_nth(cv, index);
+    if (cv->cleanup != NULL) cv->cleanup(dest);
+    cv->size--;
+    // fill the hole with the last element instead of shifting
+    if (index != cv->size) memcpy(dest, (char *)cv->elems + cv->size * cv->elemsz, cv->elemsz);
+}
 
 
 int cvec_search(const CVector *cv, const void *key, CompareFn cmp, int start, bool sorted)
 {
+    CVM_PROBE(CVM_CVEC_SEARCH);
     assert(start >= 0 && start <= cv->size);   
     char *cur = (char *)cv->elems + start * cv->elemsz;
     if (!sorted){
         //linear search if unsorted
         for (; cur != NULL; cur = cvec_next(cv, cur)){
-            if (cmp(cur, key) == 0) return (int)((cur - (char *)cv->elems) / cv->elemsz);
+            if (CVM_COUNTED(cmp)(cur, key) == 0) return (int)((cur - (char *)cv->elems) / cv->elemsz);
         }
         return -1;
     }else{
         //binary search if sorted
-        void *res = bsearch(key, cur, cv->size - start, cv->elemsz, cmp);
+        void *res = bsearch(key, cur, cv->size - start, cv->elemsz, CVM_COUNTED(cmp));
         return res == NULL ? -1 : (int)(((char *)res - (char *)cv->elems) / cv->elemsz);
     }
 
@@ -131,9 +599,669 @@ int cvec_search(const CVector *cv, const void *key, CompareFn cmp, int start, bo
 
 void cvec_sort(CVector *cv, CompareFn cmp)
 {
-    qsort(cv->elems, cv->size, cv->elemsz, cmp);
+    CVM_PROBE(CVM_CVEC_SORT);
+    qsort(cv->elems, cv->size, cv->elemsz, CVM_COUNTED(cmp));
 }
 
+// one extracted key per element, remembers the element's original index
+typedef struct {
+    uint64_t key;
+    size_t idx;
+} keyedElem;
+
+// extracted string key, bytes are compared unsigned
+typedef struct {
+    const unsigned char *bytes;
+    size_t len;
+    size_t idx;
+} strkeyedElem;
+
+// below this many keys, MSD radix hands off to insertion sort
+#define RADIX_CUTOFF 32
+
+// LSD radix sort of n keyed elems by 8-bit digits, tmp is scratch of n elems.
+// Histograms for all 8 digits are counted in one pass up front, and any pass
+// where every key has the same digit is skipped (small keys cost few passes).
+static void radix_lsd(keyedElem *keys, keyedElem *tmp, size_t n)
+{
+    size_t counts[sizeof(uint64_t)][256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; i++){
+        for (int d = 0; d < sizeof(uint64_t); d++)
+            counts[d][(keys[i].key >> (8 * d)) & 0xff]++;
+    }
+
+    keyedElem *src = keys, *dst = tmp;
+    for (int d = 0; d < sizeof(uint64_t); d++){
+        size_t *count = counts[d];
+        int shift = 8 * d;
+        if (count[(src[0].key >> shift) & 0xff] == n) continue; // digit all same
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++){ // turn counts into starting offsets
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++)
+            dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+        keyedElem *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != keys) memcpy(keys, src, n * sizeof(keyedElem));
+}
+
+// stable insertion sort of equal-length string keys, comparing from depth on
+static void strkey_insertion(strkeyedElem *keys, size_t n, size_t depth)
+{
+    for (size_t i = 1; i < n; i++){
+        strkeyedElem cur = keys[i];
+        size_t j = i;
+        while (j > 0 && memcmp(keys[j - 1].bytes + depth, cur.bytes + depth, cur.len - depth) > 0){
+            keys[j] = keys[j - 1];
+            j--;
+        }
+        keys[j] = cur;
+    }
+}
+
+// MSD radix sort of n string keys that all have the same length, all keys
+// already agree on bytes before depth. tmp is scratch of n elems. Only the
+// smaller buckets are recursed on and the largest is looped on, so each
+// frame (4KB of counts) has at most half the keys of its caller and the
+// stack stays O(log n) deep however the keys split.
+static void radix_msd(strkeyedElem *keys, strkeyedElem *tmp, size_t n, size_t depth)
+{
+    size_t len = keys[0].len;
+    while (depth < len){
+        if (n < RADIX_CUTOFF){
+            strkey_insertion(keys, n, depth);
+            return;
+        }
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++) count[keys[i].bytes[depth]]++;
+        if (count[keys[0].bytes[depth]] == n){ // shared prefix byte, no split
+            depth++;
+            continue;
+        }
+        size_t start[256], sum = 0;
+        for (int b = 0; b < 256; b++){
+            start[b] = sum;
+            sum += count[b];
+        }
+        for (size_t i = 0; i < n; i++)
+            tmp[start[keys[i].bytes[depth]]++] = keys[i];
+        memcpy(keys, tmp, n * sizeof(strkeyedElem));
+        // each bucket now agrees through depth, recur on all but the largest
+        int largest = 0;
+        for (int b = 1; b < 256; b++)
+            if (count[b] > count[largest]) largest = b;
+        size_t lo = 0, largest_lo = 0;
+        for (int b = 0; b < 256; b++){
+            if (b == largest) largest_lo = lo;
+            else if (count[b] > 1) radix_msd(keys + lo, tmp, count[b], depth + 1);
+            lo += count[b];
+        }
+        keys += largest_lo;
+        n = count[largest];
+        depth++;
+    }
+}
+
+// rearrange cv elements so that new position i holds old element order[i]
+static void permute(CVector *cv, const size_t *order, size_t stride)
+{
+    char *sorted = malloc(cv->size * cv->elemsz);
+    assert(sorted != NULL);
+    for (size_t i = 0; i < cv->size; i++){
+        size_t from = *(const size_t *)((const char *)order + i * stride);
+        memcpy(sorted + i * cv->elemsz, (char *)cv->elems + from * cv->elemsz, cv->elemsz);
+    }
+    memcpy(cv->elems, sorted, cv->size * cv->elemsz);
+    free(sorted);
+}
+
+void cvec_sort_by_key(CVector *cv, KeyFn keyfn)
+{
+    if (cv->size < 2) return;
+    keyedElem *keys = malloc(2 * cv->size * sizeof(keyedElem));
+    assert(keys != NULL);
+    for (size_t i = 0; i < cv->size; i++){
+        keys[i].key = keyfn((char *)cv->elems + i * cv->elemsz);
+        keys[i].idx = i;
+    }
+    radix_lsd(keys, keys + cv->size, cv->size);
+    permute(cv, &keys[0].idx, sizeof(keyedElem));
+    free(keys);
+}
+
+void cvec_sort_by_strkey(CVector *cv, StrKeyFn keyfn)
+{
+    if (cv->size < 2) return;
+    size_t n = cv->size;
+    keyedElem *bylen = malloc(2 * n * sizeof(keyedElem));
+    strkeyedElem *keys = malloc(2 * n * sizeof(strkeyedElem));
+    assert(bylen != NULL && keys != NULL);
+
+    // extract each key once, remembering bytes by original index
+    for (size_t i = 0; i < n; i++){
+        size_t len;
+        keys[n + i].bytes = (const unsigned char *)keyfn((char *)cv->elems + i * cv->elemsz, &len);
+        keys[n + i].len = len;
+        keys[n + i].idx = i;
+        bylen[i].key = len;
+        bylen[i].idx = i;
+    }
+    // order by length first, then MSD sort each run of equal length
+    radix_lsd(bylen, bylen + n, n);
+    for (size_t i = 0; i < n; i++) keys[i] = keys[n + bylen[i].idx];
+    for (size_t lo = 0, hi; lo < n; lo = hi){
+        for (hi = lo + 1; hi < n && keys[hi].len == keys[lo].len; hi++) ;
+        if (hi - lo > 1) radix_msd(keys + lo, keys + n, hi - lo, 0);
+    }
+    permute(cv, &keys[0].idx, sizeof(strkeyedElem));
+    free(bylen);
+    free(keys);
+}
+
+/* Type: struct CVecIndexImplementation
+ * ------------------------------------
+ * This definition completes the CVecIndex type that was declared in
+ * cvector.h. Both arrays are 1-based: node k has children 2k and 2k+1.
+ */
+struct CVecIndexImplementation {
+    uint64_t *keys;// keys in Eytzinger order, keys[0] unused
+    uint32_t *pos;// index into the CVector of the element at each node
+    size_t n;// number of keys
+};
+
+// fill nodes in an in-order walk of the implicit tree, i.e. sorted order
+static size_t eytzinger_fill(CVecIndex *idx, const CVector *cv, KeyFn keyfn, size_t i, size_t k)
+{
+    // walk down the left spine iteratively, recurse only to the right
+    for (; k <= idx->n; k = 2 * k + 1){
+        i = eytzinger_fill(idx, cv, keyfn, i, 2 * k);
+        idx->keys[k] = keyfn((char *)cv->elems + i * cv->elemsz);
+        idx->pos[k] = i++;
+    }
+    return i;
+}
+
+CVecIndex *cvec_build_index(const CVector *cv, KeyFn keyfn)
+{
+    CVecIndex *idx = malloc(sizeof(CVecIndex));
+    assert(idx != NULL);
+    idx->n = cv->size;
+    // cache-line aligned, so the 8 keys 3 levels below node k share a line
+    idx->keys = aligned_alloc(64, roundup((idx->n + 1) * sizeof(uint64_t), 64));
+    idx->pos = malloc((idx->n + 1) * sizeof(uint32_t));
+    assert(idx->keys != NULL && idx->pos != NULL);
+    eytzinger_fill(idx, cv, keyfn, 0, 1);
+    return idx;
+}
+
+int cvec_index_search(const CVecIndex *idx, uint64_t key)
+{
+    size_t k = 1;
+    while (k <= idx->n){
+        __builtin_prefetch(idx->keys + 8 * k);
+        k = 2 * k + (idx->keys[k] < key);
+    }
+    // undo the trailing right turns (and the one left turn before them) to
+    // land on the first key >= key, k is 0 if every key is smaller
+    k >>= __builtin_ffsl(~k);
+    return (k != 0 && idx->keys[k] == key) ? (int)idx->pos[k] : -1;
+}
+
+void cvec_index_dispose(CVecIndex *idx)
+{
+    free(idx->keys);
+    free(idx->pos);
+    free(idx);
+}
+
+void cvec_unique(CVector *cv, CompareFn cmp)
+{
+    if (cv->size < 2) return;
+    char *base = cv->elems, *kept = base; // last element kept so far
+    for (size_t i = 1; i < cv->size; i++){
+        char *cur = base + i * cv->elemsz;
+        bool dup = cmp != NULL ? CVM_COUNTED(cmp)(kept, cur) == 0 : memcmp(kept, cur, cv->elemsz) == 0;
+        if (dup){
+            if (cv->cleanup != NULL) cv->cleanup(cur);
+        }else{
+            kept += cv->elemsz;
+            if (kept != cur) memcpy(kept, cur, cv->elemsz);
+        }
+    }
+    cv->size = (kept - base) / cv->elemsz + 1;
+}
+
+typedef enum {SET_INTERSECT, SET_UNION, SET_DIFFERENCE} SetOp;
+
+// when one side is this many times larger, gallop through it
+#define GALLOP_RATIO 32
+
+static int cmp_u32(const void *addr1, const void *addr2)
+{
+    uint32_t val1 = *(const uint32_t *)addr1, val2 = *(const uint32_t *)addr2;
+    return (val1 > val2) - (val1 < val2);
+}
+
+static int cmp_u64(const void *addr1, const void *addr2)
+{
+    uint64_t val1 = *(const uint64_t *)addr1, val2 = *(const uint64_t *)addr2;
+    return (val1 > val2) - (val1 < val2);
+}
+
+// first index in [lo, n) whose element is >= key, n if none. Probes at
+// doubling distances from lo, then binary searches the last gap
+static size_t gallop(const char *base, size_t lo, size_t n, size_t sz, const void *key, CompareFn cmp)
+{
+    if (lo >= n || cmp(base + lo * sz, key) >= 0) return lo;
+    size_t below = lo, step = 1; // element at below is < key
+    while (below + step < n && cmp(base + (below + step) * sz, key) < 0){
+        below += step;
+        step *= 2;
+    }
+    size_t hi = below + step < n ? below + step : n;
+    lo = below + 1;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if (cmp(base + mid * sz, key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// walk the much smaller side, galloping through the larger one and
+// copying its runs whole. Returns the number of elements written to dst
+static size_t set_gallop(const char *a, size_t na, const char *b, size_t nb, size_t sz, CompareFn cmp, SetOp op, char *dst)
+{
+    size_t n = 0;
+    if (na <= nb){
+        size_t j = 0;
+        for (size_t i = 0; i < na; i++){
+            const char *x = a + i * sz;
+            size_t k = gallop(b, j, nb, sz, x, cmp);
+            if (op == SET_UNION){
+                memcpy(dst + n * sz, b + j * sz, (k - j) * sz);
+                n += k - j;
+            }
+            bool found = k < nb && cmp(b + k * sz, x) == 0;
+            if (found) k++;
+            if (found ? op != SET_DIFFERENCE : op != SET_INTERSECT) memcpy(dst + n++ * sz, x, sz);
+            j = k;
+        }
+        if (op == SET_UNION){
+            memcpy(dst + n * sz, b + j * sz, (nb - j) * sz);
+            n += nb - j;
+        }
+    }else{
+        size_t i = 0;
+        for (size_t j = 0; j < nb; j++){
+            const char *y = b + j * sz;
+            size_t k = gallop(a, i, na, sz, y, cmp);
+            if (op != SET_INTERSECT){
+                memcpy(dst + n * sz, a + i * sz, (k - i) * sz);
+                n += k - i;
+            }
+            if (k < na && cmp(a + k * sz, y) == 0){
+                if (op != SET_DIFFERENCE) memcpy(dst + n++ * sz, a + k * sz, sz);
+                k++;
+            }else if (op == SET_UNION){
+                memcpy(dst + n++ * sz, y, sz);
+            }
+            i = k;
+        }
+        if (op != SET_INTERSECT){
+            memcpy(dst + n * sz, a + i * sz, (na - i) * sz);
+            n += na - i;
+        }
+    }
+    return n;
+}
+
+// linear merge from positions i and j on, comparing through cmp
+static size_t set_merge(const char *a, size_t na, const char *b, size_t nb, size_t sz, CompareFn cmp, SetOp op, char *dst, size_t i, size_t j)
+{
+    size_t n = 0;
+    while (i < na && j < nb){
+        int res = cmp(a + i * sz, b + j * sz);
+        if (res < 0){
+            if (op != SET_INTERSECT) memcpy(dst + n++ * sz, a + i * sz, sz);
+            i++;
+        }else if (res > 0){
+            if (op == SET_UNION) memcpy(dst + n++ * sz, b + j * sz, sz);
+            j++;
+        }else{
+            if (op != SET_DIFFERENCE) memcpy(dst + n++ * sz, a + i * sz, sz);
+            i++;
+            j++;
+        }
+    }
+    if (op != SET_INTERSECT){
+        memcpy(dst + n * sz, a + i * sz, (na - i) * sz);
+        n += na - i;
+    }
+    if (op == SET_UNION){
+        memcpy(dst + n * sz, b + j * sz, (nb - j) * sz);
+        n += nb - j;
+    }
+    return n;
+}
+
+// set_merge specialized to an unsigned integer type, comparisons inlined
+#define DEFINE_SET_MERGE(name, type)                                            \
+static size_t name(const type *a, size_t na, const type *b, size_t nb, SetOp op, type *dst, size_t i, size_t j) \
+{                                                                               \
+    size_t n = 0;                                                               \
+    while (i < na && j < nb){                                                   \
+        type x = a[i], y = b[j];                                                \
+        if (x < y){                                                             \
+            if (op != SET_INTERSECT) dst[n++] = x;                              \
+            i++;                                                                \
+        }else if (x > y){                                                       \
+            if (op == SET_UNION) dst[n++] = y;                                  \
+            j++;                                                                \
+        }else{                                                                  \
+            if (op != SET_DIFFERENCE) dst[n++] = x;                             \
+            i++;                                                                \
+            j++;                                                                \
+        }                                                                       \
+    }                                                                           \
+    if (op != SET_INTERSECT) while (i < na) dst[n++] = a[i++];                  \
+    if (op == SET_UNION) while (j < nb) dst[n++] = b[j++];                      \
+    return n;                                                                   \
+}
+DEFINE_SET_MERGE(set_merge_u32, uint32_t)
+DEFINE_SET_MERGE(set_merge_u64, uint64_t)
+
+#ifdef __SSE2__
+// Intersect blocks of 4 against blocks of 4: each lane of a is compared
+// with every lane of b by rotating b three times, and matching lanes of a
+// are written out. The block with the smaller maximum is advanced (both if
+// equal). Stops when either side has less than a block left, with *pi and
+// *pj where a scalar merge should take over
+static size_t intersect_u32_sse2(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *dst, size_t *pi, size_t *pj)
+{
+    size_t i = 0, j = 0, n = 0;
+    while (i + 4 <= na && j + 4 <= nb){
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        for (int mask = _mm_movemask_ps(_mm_castsi128_ps(eq)); mask != 0; mask &= mask - 1)
+            dst[n++] = a[i + __builtin_ctz(mask)];
+        uint32_t amax = a[i + 3], bmax = b[j + 3];
+        i += (amax <= bmax) * 4;
+        j += (bmax <= amax) * 4;
+    }
+    *pi = i;
+    *pj = j;
+    return n;
+}
+
+// 64-bit lanes are equal when both 32-bit halves are (SSE2 has no cmpeq_epi64)
+static inline __m128i cmpeq_u64(__m128i x, __m128i y)
+{
+    __m128i eq32 = _mm_cmpeq_epi32(x, y);
+    return _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+// as intersect_u32_sse2, with blocks of 2
+static size_t intersect_u64_sse2(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *dst, size_t *pi, size_t *pj)
+{
+    size_t i = 0, j = 0, n = 0;
+    while (i + 2 <= na && j + 2 <= nb){
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+        __m128i eq = _mm_or_si128(cmpeq_u64(va, vb),
+                                  cmpeq_u64(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+        for (int mask = _mm_movemask_pd(_mm_castsi128_pd(eq)); mask != 0; mask &= mask - 1)
+            dst[n++] = a[i + __builtin_ctz(mask)];
+        uint64_t amax = a[i + 1], bmax = b[j + 1];
+        i += (amax <= bmax) * 2;
+        j += (bmax <= amax) * 2;
+    }
+    *pi = i;
+    *pj = j;
+    return n;
+}
+#endif
+
+static void set_operation(const CVector *a, const CVector *b, CVector *out, CompareFn cmp, SetOp op)
+{
+    size_t sz = a->elemsz, na = a->size, nb = b->size;
+    assert(b->elemsz == sz && out->elemsz == sz);
+    assert(out != a && out != b);
+    assert(cmp != NULL || sz == sizeof(uint32_t) || sz == sizeof(uint64_t));
+    size_t bound = op == SET_UNION ? na + nb : op == SET_DIFFERENCE ? na : (na < nb ? na : nb);
+    if (bound == 0) return;
+    ensure_capacity(out, out->size + bound);
+    char *dst = (char *)out->elems + out->size * sz;
+    size_t n, i = 0, j = 0;
+    if (na > GALLOP_RATIO * nb || nb > GALLOP_RATIO * na){
+        cmp = cmp != NULL ? CVM_COUNTED(cmp) : sz == sizeof(uint32_t) ? cmp_u32 : cmp_u64;
+        n = set_gallop(a->elems, na, b->elems, nb, sz, cmp, op, dst);
+    }else if (cmp == NULL && sz == sizeof(uint32_t)){
+        n = 0;
+#ifdef __SSE2__
+        if (op == SET_INTERSECT) n = intersect_u32_sse2(a->elems, na, b->elems, nb, (uint32_t *)dst, &i, &j);
+#endif
+        n += set_merge_u32(a->elems, na, b->elems, nb, op, (uint32_t *)dst + n, i, j);
+    }else if (cmp == NULL){
+        n = 0;
+#ifdef __SSE2__
+        if (op == SET_INTERSECT) n = intersect_u64_sse2(a->elems, na, b->elems, nb, (uint64_t *)dst, &i, &j);
+#endif
+        n += set_merge_u64(a->elems, na, b->elems, nb, op, (uint64_t *)dst + n, i, j);
+    }else{
+        n = set_merge(a->elems, na, b->elems, nb, sz, CVM_COUNTED(cmp), op, dst, 0, 0);
+    }
+    out->size += n;
+}
+
+void cvec_intersect(const CVector *a, const CVector *b, CVector *out, CompareFn cmp)
+{
+    set_operation(a, b, out, cmp, SET_INTERSECT);
+}
+
+void cvec_union(const CVector *a, const CVector *b, CVector *out, CompareFn cmp)
+{
+    set_operation(a, b, out, cmp, SET_UNION);
+}
+
+void cvec_difference(const CVector *a, const CVector *b, CVector *out, CompareFn cmp)
+{
+    set_operation(a, b, out, cmp, SET_DIFFERENCE);
+}
+
+// 64-bit FNV-1a taken a word at a time rather than a byte at a time
+static uint64_t checksum(const void *data, size_t n)
+{
+    const unsigned char *p = data;
+    uint64_t h = 14695981039346656037ULL, word;
+    for (; n >= sizeof(word); n -= sizeof(word), p += sizeof(word)){
+        memcpy(&word, p, sizeof(word));
+        h = (h ^ word) * 1099511628211ULL;
+    }
+    for (; n > 0; n--) h = (h ^ *p++) * 1099511628211ULL;
+    return h;
+}
+
+// write or read all n bytes, retrying partial transfers (pipes, signals)
+static bool write_full(int fd, const void *buf, size_t n)
+{
+    for (const char *p = buf; n > 0; ){
+        ssize_t done = write(fd, p, n);
+        if (done == -1 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        p += done;
+        n -= done;
+    }
+    return true;
+}
+
+static bool read_full(int fd, void *buf, size_t n)
+{
+    for (char *p = buf; n > 0; ){
+        ssize_t done = read(fd, p, n);
+        if (done == -1 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        p += done;
+        n -= done;
+    }
+    return true;
+}
+
+bool cvec_write(const CVector *cv, int fd, const CVecSerializer *ser)
+{
+    struct cvec_file_header header = {.magic = CVEC_MAGIC, .version = CVEC_FILE_VERSION,
+                                      .elemsz = cv->elemsz, .count = cv->size, .flags = CVEC_FILE_CHECKSUM};
+    if (ser == NULL){ // elements are written as they are in memory
+        header.checksum = checksum(cv->elems, cv->size * cv->elemsz);
+        return write_full(fd, &header, sizeof(header)) &&
+               write_full(fd, cv->elems, cv->size * cv->elemsz);
+    }
+    // encode everything first, the header with the checksum goes out first
+    CVector *buf = cvec_create(1, 0, NULL);
+    for (size_t i = 0; i < cv->size; i++){
+        const char *elem = (const char *)cv->elems + i * cv->elemsz;
+        size_t need = ser->encoded_size(elem);
+        ensure_capacity(buf, buf->size + need);
+        ser->encode(elem, (char *)buf->elems + buf->size);
+        buf->size += need;
+    }
+    header.flags |= CVEC_FILE_SERIALIZED;
+    header.payload = buf->size;
+    header.checksum = checksum(buf->elems, buf->size);
+    bool ok = write_full(fd, &header, sizeof(header)) && write_full(fd, buf->elems, buf->size);
+    cvec_dispose(buf);
+    return ok;
+}
+
+// bytes left to read from fd, or SIZE_MAX if it is not a regular file
+// (a pipe or socket), where there is no telling
+static size_t bytes_left(int fd)
+{
+    struct stat st;
+    off_t pos;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || (pos = lseek(fd, 0, SEEK_CUR)) == -1)
+        return SIZE_MAX;
+    return pos < st.st_size ? st.st_size - pos : 0;
+}
+
+// read n bytes into a new malloc'd buffer that grows as data arrives, so a
+// stream that ends early costs no more than twice what it held
+static bool read_payload(int fd, size_t n, char **pbuf)
+{
+    size_t cap = n < CVEC_READ_CHUNK ? n : CVEC_READ_CHUNK;
+    char *buf = malloc(cap);
+    assert(buf != NULL || cap == 0);
+    for (size_t got = 0; got < n; got = cap){
+        if (got == cap){
+            cap = 2 * cap < n ? 2 * cap : n;
+            buf = realloc(buf, cap);
+            assert(buf != NULL);
+        }
+        if (!read_full(fd, buf + got, cap - got)){
+            free(buf);
+            return false;
+        }
+    }
+    *pbuf = buf;
+    return true;
+}
+
+CVector *cvec_read(int fd, const CVecSerializer *ser)
+{
+    struct cvec_file_header header;
+    if (!read_full(fd, &header, sizeof(header)) || header.magic != CVEC_MAGIC ||
+        header.version != CVEC_FILE_VERSION || header.elemsz == 0 || header.count > INT_MAX ||
+        !(header.flags & CVEC_FILE_SERIALIZED) != (ser == NULL)) return NULL;
+    // check the header against what can follow it before allocating anything:
+    // raw elements fill the rest of a file, each encoded one takes a byte or more
+    size_t nbytes, left = bytes_left(fd);
+    if (__builtin_mul_overflow(header.count, header.elemsz, &nbytes)) return NULL;
+    if (ser == NULL ? nbytes > left : (header.payload > left || header.count > header.payload))
+        return NULL;
+    // storage the stream has not vouched for is handed out a chunk at a time
+    bool vouched = (ser == NULL && left != SIZE_MAX && header.count > 0);
+    if (!vouched && header.elemsz > CVEC_READ_CHUNK) return NULL;
+    size_t chunk = vouched ? header.count : CVEC_READ_CHUNK / header.elemsz;
+    size_t hint = header.count < chunk ? header.count : chunk;
+    CVector *cv = cvec_create(header.elemsz, hint > 0 ? hint : 1, ser == NULL ? NULL : ser->cleanup);
+    if (ser == NULL){
+        bool ok = true;
+        for (size_t done = 0; ok && done < header.count; done += chunk){
+            size_t n = header.count - done < chunk ? header.count - done : chunk;
+            ensure_capacity(cv, done + n);
+            ok = read_full(fd, (char *)cv->elems + done * cv->elemsz, n * cv->elemsz);
+        }
+        if (!ok || ((header.flags & CVEC_FILE_CHECKSUM) && checksum(cv->elems, nbytes) != header.checksum)){
+            cvec_dispose(cv);
+            return NULL;
+        }
+        cv->size = header.count;
+        return cv;
+    }
+    char *payload = NULL;
+    bool ok = read_payload(fd, header.payload, &payload) &&
+              (!(header.flags & CVEC_FILE_CHECKSUM) || checksum(payload, header.payload) == header.checksum);
+    size_t used = 0;
+    for (size_t i = 0; ok && i < header.count; i++){
+        ensure_capacity(cv, cv->size + 1);
+        size_t n = ser->decode((char *)cv->elems + i * cv->elemsz, payload + used, header.payload - used);
+        if (n == 0) ok = false;
+        else cv->size++; // decoded elements get cleaned up if a later one fails
+        used += n;
+    }
+    free(payload);
+    if (!ok){
+        cvec_dispose(cv);
+        return NULL;
+    }
+    return cv;
+}
+
+// strings are encoded as a 32-bit length followed by the bytes
+static size_t string_encoded_size(const void *elem)
+{
+    return sizeof(uint32_t) + strlen(*(char **)elem);
+}
+
+static void string_encode(const void *elem, void *buf)
+{
+    uint32_t len = strlen(*(char **)elem);
+    memcpy(buf, &len, sizeof(len));
+    memcpy((char *)buf + sizeof(len), *(char **)elem, len);
+}
+
+static size_t string_decode(void *elem, const void *buf, size_t avail)
+{
+    uint32_t len;
+    if (avail < sizeof(len)) return 0;
+    memcpy(&len, buf, sizeof(len));
+    if (avail - sizeof(len) < len) return 0;
+    char *s = malloc(len + 1);
+    assert(s != NULL);
+    memcpy(s, (const char *)buf + sizeof(len), len);
+    s[len] = '\0';
+    *(char **)elem = s;
+    return sizeof(len) + len;
+}
+
+static void string_cleanup(void *elem)
+{
+    free(*(char **)elem);
+}
+
+const CVecSerializer cvec_string_serializer = {string_encoded_size, string_encode, string_decode, string_cleanup};
+
 void *cvec_first(const CVector *cv)
 {
     if (cv->size == 0) return NULL;
@@ -19,6 +19,9 @@
 
 #include <stdbool.h>	//  this header defines C99 bool type
 #include <stddef.h> 	// size_t
+#include <stdint.h> 	// uint64_t
+#include "carena.h"
+#include "callocator.h"
 
 /**
  * Type: CompareFn
@@ -57,6 +60,82 @@ typedef int (*CompareFn)(const void *addr1, const void *addr2);
 typedef void (*CleanupElemFn)(void *addr);
 
 
+/**
+ * Type: KeyFn
+ * -----------
+ * KeyFn is the typename for a pointer to a client-supplied key extractor
+ * used by cvec_sort_by_key. It takes a const void* pointer to an element
+ * and returns a fixed-width unsigned integer key for that element. Elements
+ * are ordered by increasing key. To sort by a signed key, the client can
+ * flip the sign bit, e.g. return (uint64_t)val ^ (1ULL << 63).
+ */
+typedef uint64_t (*KeyFn)(const void *addr);
+
+
+/**
+ * Type: StrKeyFn
+ * --------------
+ * StrKeyFn is the typename for a pointer to a client-supplied string key
+ * extractor used by cvec_sort_by_strkey. It takes a const void* pointer to
+ * an element, returns a pointer to the key bytes and stores the number of
+ * key bytes through plen. The bytes must remain valid and unchanged for the
+ * duration of the sort.
+ */
+typedef const char *(*StrKeyFn)(const void *addr, size_t *plen);
+
+
+/**
+ * Type: CVecAdvice
+ * ----------------
+ * Access pattern hints a client can give for a file-backed CVector with
+ * cvec_advise. SEQUENTIAL suits front-to-back iteration (aggressive
+ * read-ahead), RANDOM suits scattered cvec_nth lookups (no read-ahead).
+ */
+typedef enum {
+    CVEC_ADVICE_NORMAL,
+    CVEC_ADVICE_SEQUENTIAL,
+    CVEC_ADVICE_RANDOM
+} CVecAdvice;
+
+
+/**
+ * Type: CVecSerializer
+ * --------------------
+ * A set of client functions that cvec_write and cvec_read use to store
+ * elements that cannot be written as raw bytes, such as pointers to
+ * strings. encoded_size returns the number of bytes encode will write for
+ * an element. decode rebuilds an element at elem from the bytes at buf,
+ * of which avail are left in the payload, and returns the number of bytes
+ * used, or 0 if they are malformed. cleanup becomes the cleanup fn of the
+ * CVector that cvec_read returns, and should release whatever decode
+ * allocated.
+ */
+typedef struct {
+    size_t (*encoded_size)(const void *elem);
+    void (*encode)(const void *elem, void *buf);
+    size_t (*decode)(void *elem, const void *buf, size_t avail);
+    CleanupElemFn cleanup;
+} CVecSerializer;
+
+/**
+ * Constant: cvec_string_serializer
+ * --------------------------------
+ * A CVecSerializer for a CVector of char * elements pointing to
+ * heap-allocated strings. Each string is stored as its length and bytes;
+ * cvec_read allocates each string with malloc and frees them at dispose.
+ */
+extern const CVecSerializer cvec_string_serializer;
+
+
+/**
+ * Type: CVecIndex
+ * ---------------
+ * A read-only search index built from a sorted CVector by cvec_build_index.
+ * The type is incomplete and clients only ever hold CVecIndex* pointers.
+ */
+typedef struct CVecIndexImplementation CVecIndex;
+
+
 /**
  * Type: CVector
  * -------------
@@ -112,6 +191,133 @@ typedef struct CVectorImplementation CVector;
 CVector *cvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
 
 
+/**
+ * Function: cvec_create_in
+ * Usage: CVector *v = cvec_create_in(arena, sizeof(int), 10, NULL)
+ * ----------------------------------------------------------------
+ * Creates a new empty CVector that lives inside the given CArena. The
+ * parameters have the same meaning as for cvec_create. The CVector struct and
+ * all of its element storage are allocated from the arena, and growth
+ * extends the storage in place when it is the arena's most recent
+ * allocation. When the arena is disposed, the cleanup fn (if any) is called
+ * on every remaining element and the storage is released along with the
+ * rest of the arena. Calling cvec_dispose on such a CVector is allowed: it
+ * cleans up the elements right away, but the memory is only reclaimed when
+ * the arena is disposed. The CVector must not be used after its arena is
+ * disposed.
+ *
+ * Asserts: zero elemsz, allocation failure
+ * Assumes: arena is valid, cleanup fn is valid
+ */
+CVector *cvec_create_in(CArena *arena, size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
+
+
+/**
+ * Function: cvec_create_ex
+ * Usage: CVector *v = cvec_create_ex(&my_allocator, sizeof(int), 10, NULL)
+ * ------------------------------------------------------------------------
+ * Creates a new empty CVector whose memory all comes from the given
+ * CAllocator instead of malloc: the CVector struct, and its element
+ * storage as it grows, shrinks and is disposed. The other parameters have
+ * the same meaning as for cvec_create. Storage does not move to huge pages
+ * unless the client sets a threshold with cvec_set_growth. Scratch
+ * buffers that a sort allocates and frees within one call still come from
+ * malloc. The allocator must remain valid until the CVector is disposed.
+ *
+ * Asserts: zero elemsz, allocation failure
+ * Assumes: allocator is valid, cleanup fn is valid
+ */
+CVector *cvec_create_ex(const CAllocator *allocator, size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
+
+
+/**
+ * Function: cvec_open_mapped
+ * Usage: CVector *v = cvec_open_mapped("paths.cvec", sizeof(ino_t))
+ * -----------------------------------------------------------------
+ * Opens a CVector whose element storage is a memory-mapped file, creating
+ * the file if it does not exist. An existing file written by a previous
+ * cvec_open_mapped is mapped and used in place with no parsing, so its
+ * elements are immediately available. Growth lengthens the file and remaps
+ * it. All operations work as for any other CVector, and pointers returned
+ * by cvec_nth/cvec_first/cvec_next point directly into the mapped file.
+ * cvec_dispose records the count in the file, trims unused capacity from it
+ * and unmaps it; the file itself is kept. Elements are stored as raw bytes,
+ * so they must not contain pointers and no cleanup fn is applied.
+ *
+ * Returns NULL if the file cannot be opened or mapped, or if it exists but
+ * was not written by cvec_open_mapped or cvec_write (without a serializer)
+ * with the same elemsz.
+ *
+ * Asserts: zero elemsz, allocation failure
+ */
+CVector *cvec_open_mapped(const char *path, size_t elemsz);
+
+
+/**
+ * Function: cvec_advise
+ * Usage: cvec_advise(v, CVEC_ADVICE_SEQUENTIAL)
+ * ---------------------------------------------
+ * Passes an access pattern hint for a file-backed CVector on to the kernel
+ * (madvise), which tunes read-ahead and paging for the mapped file. Has no
+ * effect on a CVector that is not file-backed.
+ */
+void cvec_advise(CVector *cv, CVecAdvice advice);
+
+
+/**
+ * Functions: cvec_write, cvec_read
+ * Usage: cvec_write(v, fd, NULL)
+ *        CVector *v = cvec_read(fd, NULL)
+ * -----------------------------------------
+ * Save a CVector to an open file descriptor and load it back, for passing
+ * results between programs without printing and parsing text. The format
+ * is the one cvec_open_mapped uses: a versioned header carrying the
+ * elemsz, the count and a checksum of what follows, then the elements.
+ * With a NULL serializer, elements are written as raw bytes, so they must
+ * not contain pointers; with a serializer (e.g. cvec_string_serializer)
+ * each element is encoded by it. The descriptor may be a pipe or socket:
+ * each function transfers the data front to back, resuming partial reads
+ * and writes, and leaves the descriptor open.
+ *
+ * cvec_write returns false if a write fails. cvec_read returns a new
+ * CVector, with the serializer's cleanup fn if one is given, or NULL if
+ * the data is truncated, is not a CVector file, fails its checksum, was
+ * written with a serializer and read without one (or the reverse), or
+ * cannot be decoded. The header is checked against the bytes left in a
+ * regular file before anything is allocated; from a pipe, storage grows
+ * only as data arrives, so elements over 1MB (or any serialized ones that
+ * large) can only be read back from a regular file that holds at least
+ * one of them. Both operate in linear-time.
+ *
+ * Asserts: allocation failure
+ * Assumes: the same serializer, or none, is used to write and to read
+ */
+bool cvec_write(const CVector *cv, int fd, const CVecSerializer *ser);
+CVector *cvec_read(int fd, const CVecSerializer *ser);
+
+
+/**
+ * Function: cvec_view_mapped
+ * Usage: CVector *v = cvec_view_mapped("inodes.cvec")
+ * ---------------------------------------------------
+ * Maps a file written by cvec_write (without a serializer) or by
+ * cvec_open_mapped read-only and returns a CVector whose elements are the
+ * file's bytes in place: nothing is copied or parsed, so a view of any
+ * size opens in constant time and pages are read in as elements are
+ * touched. The elemsz comes from the file. The CVector must not be
+ * modified; the read operations (count, nth, search, first/next) all work
+ * as usual. The checksum is not verified, since that would read the whole
+ * file; use cvec_read to load with verification. cvec_dispose unmaps the
+ * file and leaves it unchanged.
+ *
+ * Returns NULL if the file cannot be opened or mapped, or is not a raw
+ * CVector file.
+ *
+ * Asserts: allocation failure
+ */
+CVector *cvec_view_mapped(const char *path);
+
+
 /**
  * Function: cvec_dispose
  * Usage: cvec_dispose(v)
@@ -122,6 +328,44 @@ CVector *cvec_create(size_t elemsz, size_t capacity_hint, CleanupElemFn fn);
 void cvec_dispose(CVector *cv);
 
 
+/**
+ * Functions: cvec_reserve, cvec_shrink_to_fit
+ * Usage: cvec_reserve(v, 1000000)
+ *        cvec_shrink_to_fit(v)
+ * -------------------------------------------
+ * cvec_reserve enlarges the CVector's capacity to hold at least nelems
+ * elements, so that many appends can follow without resizing. It never
+ * reduces capacity. cvec_shrink_to_fit reduces capacity to the current
+ * count, releasing unused storage (a small enough CVector moves back into
+ * its inline buffer). Storage inside a CArena is not reclaimed until the
+ * arena is disposed. Both operate in linear-time at worst, since elements
+ * may be copied to new storage. An assert is raised on allocation failure.
+ *
+ * Asserts: allocation failure
+ */
+void cvec_reserve(CVector *cv, size_t nelems);
+void cvec_shrink_to_fit(CVector *cv);
+
+
+/**
+ * Function: cvec_set_growth
+ * Usage: cvec_set_growth(v, 1.5, 64 << 20)
+ * ----------------------------------------
+ * Configures how the CVector grows when it runs out of capacity. factor is
+ * the multiplier applied to the capacity each time it is outgrown (the
+ * default is 2); it must be greater than 1. Once the CVector's storage
+ * reaches huge_threshold bytes, it is moved from the heap to an anonymous
+ * memory mapping advised to use huge pages, which reduces TLB misses on
+ * large vectors, and further growth remaps the storage instead of copying
+ * it. Pass 0 for huge_threshold to keep storage on the heap at any size.
+ * Has no effect on the storage of arena-backed or file-backed vectors
+ * other than the growth factor.
+ *
+ * Asserts: factor not greater than 1
+ */
+void cvec_set_growth(CVector *cv, double factor, size_t huge_threshold);
+
+
 /**
  * Function: cvec_count
  * Usage: int count = cvec_count(v)
@@ -185,6 +429,39 @@ void cvec_insert(CVector *cv, const void *addr, int index);
 void cvec_append(CVector *cv, const void *addr);
   
   
+/**
+ * Function: cvec_append_n
+ * Usage: cvec_append_n(v, arr, 10)
+ * --------------------------------
+ * Appends n new elements to the end of the CVector. addr is expected to be
+ * a valid pointer to n consecutive elements (e.g. a C array), which are
+ * copied into internal CVector storage in order. Capacity is enlarged at
+ * most once, an assert is raised on allocation failure. Operates in time
+ * linear in n (amortized).
+ *
+ * Asserts: allocation failure
+ * Assumes: address of n valid elems
+ */
+void cvec_append_n(CVector *cv, const void *addr, size_t n);
+
+
+/**
+ * Function: cvec_insert_range
+ * Usage: cvec_insert_range(v, arr, 10, 0)
+ * ---------------------------------------
+ * Inserts n new elements into the CVector, placing the first at the given
+ * index and shifting up the elements previously at index and above to make
+ * room. addr is expected to be a valid pointer to n consecutive elements.
+ * An assert is raised if index is less than 0 or greater than the count.
+ * Existing elements are shifted with a single move and capacity is enlarged
+ * at most once. Operates in linear-time.
+ *
+ * Asserts: invalid index, allocation failure
+ * Assumes: address of n valid elems
+ */
+void cvec_insert_range(CVector *cv, const void *addr, size_t n, int index);
+
+
 /**
  * Function: cvec_replace
  * Usage: cvec_replace(v, &elem, 0)
@@ -198,10 +475,6 @@ void cvec_append(CVector *cv, const void *addr);
  *
  * Asserts: invalid index
  * Assumes: address of valid elem
- *
- * CS107 SPR1617 assign3 notes: You are not required to implement this
- * function. You may just leave a "stub" (a function where the body is
- * empty so it does nothing).
  */
 void cvec_replace(CVector *cv, const void *addr, int index);
 
@@ -216,12 +489,37 @@ void cvec_replace(CVector *cv, const void *addr, int index);
  * out of bounds. Operates in linear-time.
  *
  * Asserts: invalid index
- *
- * CS107 SPR1617 assign3 notes: You are not required to implement this
- * function. You may just leave a "stub" (a function where the body is
- * empty so it does nothing).
  */
 void cvec_remove(CVector *cv, int index);
+
+
+/**
+ * Function: cvec_remove_range
+ * Usage: cvec_remove_range(v, 0, 10)
+ * ----------------------------------
+ * Removes n elements starting at the given index and shifts the remaining
+ * elements down to close the gap with a single move. The client's cleanup
+ * function is called on each element being removed. An assert is raised if
+ * index is less than 0 or index + n is greater than the count. Operates in
+ * linear-time.
+ *
+ * Asserts: invalid range
+ */
+void cvec_remove_range(CVector *cv, int index, size_t n);
+
+
+/**
+ * Function: cvec_swap_remove
+ * Usage: cvec_swap_remove(v, 0)
+ * -----------------------------
+ * Removes the element at the given index by moving the last element of the
+ * CVector into its place. This does not preserve the order of elements, but
+ * operates in constant-time. The client's cleanup function is called on the
+ * element being removed. An assert is raised if index is out of bounds.
+ *
+ * Asserts: invalid index
+ */
+void cvec_swap_remove(CVector *cv, int index);
   
   
 /**
@@ -267,6 +565,101 @@ int cvec_search(const CVector *cv, const void *keyaddr, CompareFn cmp, int start
 void cvec_sort(CVector *cv, CompareFn cmp);
 
 
+/**
+ * Functions: cvec_sort_by_key, cvec_sort_by_strkey
+ * Usage: cvec_sort_by_key(v, ino_key)
+ *        cvec_sort_by_strkey(v, path_key)
+ * ------------------------------------------------
+ * Rearranges elements in the CVector into ascending order of a key that is
+ * extracted exactly once per element, rather than compared through a
+ * CompareFn on every step. cvec_sort_by_key orders by a 64-bit unsigned key
+ * using an LSD radix sort (digit passes where all keys agree are skipped).
+ * cvec_sort_by_strkey orders by (length, bytes): shorter keys first, keys
+ * of equal length in unsigned byte order, using an MSD radix sort. Both
+ * sorts are stable. Operates in linear-time in the number of elements
+ * (times the key width), and uses temporary storage proportional to the
+ * size of the CVector.
+ *
+ * Asserts: allocation failure
+ * Assumes: key fn is valid
+ */
+void cvec_sort_by_key(CVector *cv, KeyFn keyfn);
+void cvec_sort_by_strkey(CVector *cv, StrKeyFn keyfn);
+
+
+/**
+ * Functions: cvec_build_index, cvec_index_search, cvec_index_dispose
+ * Usage: CVecIndex *idx = cvec_build_index(v, ino_key);
+ *        int found = cvec_index_search(idx, ino);
+ *        cvec_index_dispose(idx);
+ * ------------------------------------------------------------------
+ * For many membership queries against a CVector that is sorted and no
+ * longer changing. cvec_build_index extracts each element's key once with
+ * keyfn and stores a copy of the keys in Eytzinger order (the order of a
+ * breadth-first walk of the implicit binary search tree), so the first
+ * levels of every search share a few cache lines and each step's children
+ * sit together. cvec_index_search walks down without a branch on the
+ * comparison and prefetches the cache line several levels ahead. It
+ * returns the index into the CVector of the first element whose key equals
+ * key, or -1 if there is none. The index is a copy: later changes to the
+ * CVector are not reflected, and it remains valid after the CVector is
+ * disposed. Building operates in linear-time, searching in
+ * logarithmic-time, and the index uses 12 bytes per element.
+ *
+ * Asserts: allocation failure
+ * Assumes: CVector sorted by increasing key, key fn is valid
+ */
+CVecIndex *cvec_build_index(const CVector *cv, KeyFn keyfn);
+int cvec_index_search(const CVecIndex *idx, uint64_t key);
+void cvec_index_dispose(CVecIndex *idx);
+
+
+/**
+ * Function: cvec_unique
+ * Usage: cvec_unique(v, cmp_int)
+ * ------------------------------
+ * Removes all but the first of each run of consecutive elements that
+ * compare equal, so a sorted CVector is left with no duplicates. The
+ * client's cleanup function is called on each element removed. If cmp is
+ * NULL, elements are equal when their bytes are equal. Operates in
+ * linear-time, in place.
+ *
+ * Assumes: cmp fn is valid
+ */
+void cvec_unique(CVector *cv, CompareFn cmp);
+
+
+/**
+ * Functions: cvec_intersect, cvec_union, cvec_difference
+ * Usage: cvec_intersect(scan1, scan2, common, cmp_ino)
+ * ----------------------------------------------------
+ * Combine two sorted CVectors as sets and append the result, in sorted
+ * order, to out: elements in both a and b (intersect), in either
+ * (union, an element in both is taken from a), or in a but not in b
+ * (difference). The elements appended are shallow copies, so if they own
+ * memory only one of the CVectors involved should have a cleanup function.
+ * Capacity for the largest possible result is reserved in out up front.
+ *
+ * If cmp is NULL the elements must be uint32_t or uint64_t (elemsz 4 or 8)
+ * and are ordered as unsigned integers. This selects fast paths: a merge
+ * with the comparison inlined, and for intersection an SSE2 kernel that
+ * compares a block of a against a block of b at once. Whatever cmp is,
+ * when one CVector is more than 32 times the size of the other, the
+ * smaller one is walked and the position in the larger one found by
+ * galloping (exponential then binary search), and runs of the larger one
+ * are copied whole. Operates in linear-time in the combined size, or in
+ * time proportional to the smaller size times the log of the larger one
+ * when galloping.
+ *
+ * Asserts: mismatched elemsz, out same as a or b, NULL cmp with elemsz
+ *          other than 4 or 8, allocation failure
+ * Assumes: a and b sorted by cmp, each without duplicates
+ */
+void cvec_intersect(const CVector *a, const CVector *b, CVector *out, CompareFn cmp);
+void cvec_union(const CVector *a, const CVector *b, CVector *out, CompareFn cmp);
+void cvec_difference(const CVector *a, const CVector *b, CVector *out, CompareFn cmp);
+
+
 /**
  * Functions: cvec_first, cvec_next
  * Usage: for (void *cur = cvec_first(v); cur != NULL; cur = cvec_next(v, cur))
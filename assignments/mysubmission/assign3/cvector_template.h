@@ -0,0 +1,214 @@
+/* File: cvector_template.h
+ * ------------------------
+ * Generates CVectors specialized to one element type at compile time.
+ *
+ * CVECTOR_DEFINE(name, type, cmp) defines a struct type `name` and a set of
+ * static inline functions name_create, name_nth, name_append, name_sort,
+ * name_search and so on. Because the element type is known, indexing is a
+ * plain array access, element copies are assignments, and the sort and
+ * search inline the comparison instead of calling through a CompareFn.
+ *
+ * A typed vector IS a CVector: it is created by cvec_create and the
+ * generated struct spells out the first fields of the CVector's own
+ * struct (the layout is checked in cvector.c). A typed vector converts to
+ * a CVector * with name_cvec to be passed to any cvec_ function, and
+ * name_from converts back. The inline functions only ever touch elements
+ * that are already in capacity; growing and everything else go through
+ * the library, so file-backed, arena and huge-page vectors all work.
+ *
+ * The cmp argument names a function or macro taking two elements by value
+ * and returning <0, 0 or >0 in the manner of strcmp, for example
+ *
+ *     #define CMP_INT(a, b) (((a) > (b)) - ((a) < (b)))
+ *     CVECTOR_DEFINE(IntVec, int, CMP_INT)
+ *
+ *     IntVec *v = IntVec_create(0);
+ *     IntVec_append(v, 107);
+ *     IntVec_sort(v);
+ *     int found = IntVec_search(v, 107);
+ *     IntVec_dispose(v);
+ *
+ * Elements never get a cleanup function; store types that need none, or
+ * create the CVector with cvec_create and view it with name_from.
+ */
+
+#ifndef _cvector_template_h
+#define _cvector_template_h
+
+#include <assert.h>
+#include "cvector.h"
+
+/* Type: struct cvec_layout
+ * ------------------------
+ * The fields every CVector starts with, in order. Generated structs have
+ * the same fields with elems typed, and cvector.c asserts that its struct
+ * begins this way.
+ */
+struct cvec_layout {
+    void *elems;     // first element
+    size_t nelems;   // capacity
+    size_t elemsz;   // size of one element in bytes
+    size_t size;     // count of elements stored
+};
+
+// below this many elements introsort finishes with insertion sort
+#define CVEC_TEMPLATE_ISORT 16
+
+/**
+ * Macro: CVECTOR_DEFINE
+ * Usage: CVECTOR_DEFINE(U64Vec, uint64_t, CMP_U64)
+ * ------------------------------------------------
+ * Defines the typed vector `name` holding elements of `type`, ordered by
+ * `cmp`. Use at file scope, once per name. The generated functions are:
+ *
+ *   name *name_create(size_t capacity_hint)      cvec_create(sizeof(type), hint, NULL)
+ *   name *name_from(CVector *cv)                  view a CVector, asserts elemsz matches
+ *   CVector *name_cvec(name *v)                   view as a CVector
+ *   void name_dispose(name *v)
+ *   int name_count(const name *v)
+ *   type *name_nth(const name *v, int index)      asserts invalid index
+ *   void name_append(name *v, type elem)
+ *   void name_sort(name *v)                       introsort, not stable
+ *   int name_search(const name *v, type key)      binary search of a sorted vector,
+ *                                                 returns an index or -1
+ */
+#define CVECTOR_DEFINE(name, type, cmp)                                          \
+                                                                                 \
+typedef struct name name;                                                        \
+struct name {                                                                    \
+    type *elems;                                                                 \
+    size_t nelems;                                                               \
+    size_t elemsz;                                                               \
+    size_t size;                                                                 \
+} __attribute__((may_alias));                                                    \
+                                                                                 \
+static inline name *name##_create(size_t capacity_hint)                          \
+{                                                                                \
+    return (name *)cvec_create(sizeof(type), capacity_hint, NULL);               \
+}                                                                                \
+                                                                                 \
+static inline name *name##_from(CVector *cv)                                     \
+{                                                                                \
+    assert(((name *)cv)->elemsz == sizeof(type));                                \
+    return (name *)cv;                                                           \
+}                                                                                \
+                                                                                 \
+static inline CVector *name##_cvec(name *v)                                      \
+{                                                                                \
+    return (CVector *)v;                                                         \
+}                                                                                \
+                                                                                 \
+static inline void name##_dispose(name *v)                                       \
+{                                                                                \
+    cvec_dispose((CVector *)v);                                                  \
+}                                                                                \
+                                                                                 \
+static inline int name##_count(const name *v)                                    \
+{                                                                                \
+    return (int)v->size;                                                         \
+}                                                                                \
+                                                                                 \
+static inline type *name##_nth(const name *v, int index)                         \
+{                                                                                \
+    assert(index >= 0 && index < v->size);                                       \
+    return &v->elems[index];                                                     \
+}                                                                                \
+                                                                                 \
+static inline void name##_append(name *v, type elem)                             \
+{                                                                                \
+    if (v->size < v->nelems) v->elems[v->size++] = elem;                         \
+    else cvec_append((CVector *)v, &elem); /* library grows the storage */       \
+}                                                                                \
+                                                                                 \
+static inline void name##_swap(type *a, type *b)                                 \
+{                                                                                \
+    type tmp = *a;                                                               \
+    *a = *b;                                                                     \
+    *b = tmp;                                                                    \
+}                                                                                \
+                                                                                 \
+static void name##_isort(type *base, size_t n)                                   \
+{                                                                                \
+    for (size_t i = 1; i < n; i++) {                                             \
+        type cur = base[i];                                                      \
+        size_t j = i;                                                            \
+        for (; j > 0 && cmp(cur, base[j - 1]) < 0; j--) base[j] = base[j - 1];   \
+        base[j] = cur;                                                           \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+static void name##_siftdown(type *base, size_t root, size_t n)                   \
+{                                                                                \
+    for (size_t child; (child = 2 * root + 1) < n; root = child) {               \
+        if (child + 1 < n && cmp(base[child], base[child + 1]) < 0) child++;     \
+        if (cmp(base[root], base[child]) >= 0) return;                           \
+        name##_swap(&base[root], &base[child]);                                  \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+static void name##_heapsort(type *base, size_t n)                                \
+{                                                                                \
+    for (size_t i = n / 2; i > 0; i--) name##_siftdown(base, i - 1, n);          \
+    for (size_t i = n - 1; i > 0; i--) {                                         \
+        name##_swap(&base[0], &base[i]);                                         \
+        name##_siftdown(base, 0, i);                                             \
+    }                                                                            \
+}                                                                                \
+                                                                                 \
+/* quicksort with median-of-3 pivot, heapsort once depth runs out */            \
+static void name##_introsort(type *base, size_t n, int depth)                    \
+{                                                                                \
+    while (n > CVEC_TEMPLATE_ISORT) {                                            \
+        if (depth-- == 0) {                                                      \
+            name##_heapsort(base, n);                                            \
+            return;                                                              \
+        }                                                                        \
+        type *mid = base + n / 2, *last = base + n - 1;                          \
+        if (cmp(*mid, *base) < 0) name##_swap(mid, base);                        \
+        if (cmp(*last, *mid) < 0) {                                              \
+            name##_swap(last, mid);                                              \
+            if (cmp(*mid, *base) < 0) name##_swap(mid, base);                    \
+        }                                                                        \
+        type pivot = *mid;                                                       \
+        size_t i = 0, j = n - 1;                                                 \
+        for (;;) {                                                               \
+            while (cmp(base[i], pivot) < 0) i++;                                 \
+            while (cmp(pivot, base[j]) < 0) j--;                                 \
+            if (i >= j) break;                                                   \
+            name##_swap(&base[i++], &base[j--]);                                 \
+        }                                                                        \
+        /* recurse into the smaller side, loop on the larger */                  \
+        size_t left = j + 1;                                                     \
+        if (left < n - left) {                                                   \
+            name##_introsort(base, left, depth);                                 \
+            base += left;                                                        \
+            n -= left;                                                           \
+        } else {                                                                 \
+            name##_introsort(base + left, n - left, depth);                      \
+            n = left;                                                            \
+        }                                                                        \
+    }                                                                            \
+    name##_isort(base, n);                                                       \
+}                                                                                \
+                                                                                 \
+static inline void name##_sort(name *v)                                          \
+{                                                                                \
+    int depth = 0;                                                               \
+    for (size_t n = v->size; n > 1; n >>= 1) depth += 2;                         \
+    name##_introsort(v->elems, v->size, depth);                                  \
+}                                                                                \
+                                                                                 \
+static inline int name##_search(const name *v, type key)                         \
+{                                                                                \
+    size_t lo = 0, hi = v->size;                                                 \
+    while (lo < hi) {                                                            \
+        size_t mid = lo + (hi - lo) / 2;                                         \
+        int res = cmp(key, v->elems[mid]);                                       \
+        if (res == 0) return (int)mid;                                           \
+        if (res < 0) hi = mid;                                                   \
+        else lo = mid + 1;                                                       \
+    }                                                                            \
+    return -1;                                                                   \
+}
+
+#endif
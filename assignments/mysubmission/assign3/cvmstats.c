@@ -0,0 +1,71 @@
+/*
+ * File: cvmstats.c
+ * Author: Tiantian Tang
+ * ----------------------
+ * Storage for the CVM_STATS counters and their report. Compiled either
+ * way so clients can call cvm_stats_dump unconditionally.
+ */
+#include "cvmstats.h"
+#include <string.h>
+
+#ifdef CVM_STATS
+
+struct cvm_stats cvm_stats;
+
+__thread int (*cvm_counted_cmp)(const void *, const void *);
+
+int cvm_count_cmp(const void *addr1, const void *addr2)
+{
+    cvm_stats.compares++;
+    return cvm_counted_cmp(addr1, addr2);
+}
+
+static const char *probe_names[CVM_NPROBES] = {
+    [CVM_CVEC_APPEND] = "cvec_append",
+    [CVM_CVEC_INSERT_RANGE] = "cvec_insert_range",
+    [CVM_CVEC_REMOVE_RANGE] = "cvec_remove_range",
+    [CVM_CVEC_SEARCH] = "cvec_search",
+    [CVM_CVEC_SORT] = "cvec_sort",
+    [CVM_CMAP_PUT] = "cmap_put",
+    [CVM_CMAP_GET] = "cmap_get",
+    [CVM_CMAP_NEXT] = "cmap_next",
+};
+
+void cvm_stats_dump(FILE *fp)
+{
+    const struct cvm_stats *s = &cvm_stats;
+    fprintf(fp, "CVector/CMap operation counts\n");
+    fprintf(fp, "  %-20s %12lu  (%lu bytes copied)\n", "storage moves", s->moves, s->move_bytes);
+    fprintf(fp, "  %-20s %12lu  (%lu bytes moved)\n", "insert/remove shifts", s->shifts, s->shift_bytes);
+    fprintf(fp, "  %-20s %12lu\n", "comparator calls", s->compares);
+    fprintf(fp, "  %-20s %12lu\n", "hashes", s->hashes);
+    fprintf(fp, "  %-20s %12lu  (%.2f per hash)\n", "chain probes", s->probes,
+            s->hashes ? (double)s->probes / s->hashes : 0.0);
+    fprintf(fp, "  %-20s %12lu\n", "cells allocated", s->cells);
+#ifdef CVM_STATS_CYCLES
+    fprintf(fp, "  %-20s %12s %16s %12s\n", "function", "calls", "cycles", "per call");
+    for (int i = 0; i < CVM_NPROBES; i++) {
+        if (s->calls[i] == 0) continue;
+        fprintf(fp, "  %-20s %12lu %16lu %12.1f\n", probe_names[i], s->calls[i], s->cycles[i],
+                (double)s->cycles[i] / s->calls[i]);
+    }
+#else
+    fprintf(fp, "  %-20s %12s\n", "function", "calls");
+    for (int i = 0; i < CVM_NPROBES; i++) {
+        if (s->calls[i] != 0) fprintf(fp, "  %-20s %12lu\n", probe_names[i], s->calls[i]);
+    }
+#endif
+}
+
+void cvm_stats_reset(void)
+{
+    memset(&cvm_stats, 0, sizeof(cvm_stats));
+}
+
+#else
+
+void cvm_stats_dump(FILE *fp) {}
+
+void cvm_stats_reset(void) {}
+
+#endif
@@ -0,0 +1,142 @@
+/* File: cvmstats.h
+ * ----------------
+ * Defines operation counters and timing probes for CVector and CMap.
+ *
+ * When the library is compiled with -DCVM_STATS, CVector and CMap count
+ * the work done underneath their API calls: element storage moves and the
+ * bytes they copy, shifts of elements for insert/remove and the bytes they
+ * move, comparator calls, hashes, hash chain probes and cells allocated.
+ * Adding -DCVM_STATS_CYCLES also totals the cycles (read with rdtsc on
+ * x86, nanoseconds elsewhere) and calls of each probed API function.
+ * cvm_stats_dump reports everything counted so far. Rebuild from clean
+ * when switching modes, e.g.
+ *
+ *     make clean all CPPFLAGS="-DCVM_STATS -DCVM_STATS_CYCLES"
+ *
+ * Without CVM_STATS every counter and probe compiles to nothing, so a
+ * regular build has no overhead, and cvm_stats_dump prints nothing. The
+ * counters are plain globals: counts from several threads using
+ * containers at once are approximate.
+ */
+
+#ifndef _cvmstats_h
+#define _cvmstats_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Type: CvmProbe
+ * --------------
+ * The API functions whose calls and cycles are totalled by a
+ * CVM_STATS_CYCLES build. cvec_insert is counted as cvec_insert_range and
+ * cvec_remove as cvec_remove_range.
+ */
+typedef enum {
+    CVM_CVEC_APPEND,
+    CVM_CVEC_INSERT_RANGE,
+    CVM_CVEC_REMOVE_RANGE,
+    CVM_CVEC_SEARCH,
+    CVM_CVEC_SORT,
+    CVM_CMAP_PUT,
+    CVM_CMAP_GET,
+    CVM_CMAP_NEXT,
+    CVM_NPROBES
+} CvmProbe;
+
+/**
+ * Type: struct cvm_stats
+ * ----------------------
+ * Everything counted since the program started or cvm_stats_reset.
+ */
+struct cvm_stats {
+    uint64_t moves;         // element storage reallocated or moved
+    uint64_t move_bytes;    // bytes copied by those moves, 0 when realloc or mremap resized in place
+    uint64_t shifts;        // memmoves making or closing a gap for insert/remove
+    uint64_t shift_bytes;   // bytes moved by those memmoves
+    uint64_t compares;      // client comparator calls
+    uint64_t hashes;        // keys hashed
+    uint64_t probes;        // hash chain cells examined
+    uint64_t cells;         // hash cells allocated
+    uint64_t calls[CVM_NPROBES];
+    uint64_t cycles[CVM_NPROBES];
+};
+
+
+#ifdef CVM_STATS
+
+extern struct cvm_stats cvm_stats;
+
+// comparator currently wrapped by CVM_COUNTED, and the wrapper itself
+extern __thread int (*cvm_counted_cmp)(const void *, const void *);
+int cvm_count_cmp(const void *addr1, const void *addr2);
+
+#define CVM_COUNT(field, n) (cvm_stats.field += (n))
+#define CVM_COUNTED(cmp) (cvm_counted_cmp = (cmp), cvm_count_cmp)
+
+#ifdef CVM_STATS_CYCLES
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t cvm_cycles(void)
+{
+    return __rdtsc();
+}
+#else
+#include <time.h>
+static inline uint64_t cvm_cycles(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+struct cvm_probe {
+    CvmProbe id;
+    uint64_t start;
+};
+
+static inline void cvm_probe_end(struct cvm_probe *probe)
+{
+    cvm_stats.calls[probe->id]++;
+    cvm_stats.cycles[probe->id] += cvm_cycles() - probe->start;
+}
+
+// the probe is ended by the cleanup attribute however the function returns
+#define CVM_PROBE(id) \
+    struct cvm_probe cvm_probe_ __attribute__((cleanup(cvm_probe_end))) = {id, cvm_cycles()}
+#else
+#define CVM_PROBE(id) (cvm_stats.calls[id]++)
+#endif
+
+#else
+
+// sizeof keeps variables used only in counts from being reported unused,
+// without evaluating anything
+#define CVM_COUNT(field, n) ((void)sizeof(n))
+#define CVM_COUNTED(cmp) (cmp)
+#define CVM_PROBE(id) ((void)0)
+
+#endif
+
+
+/**
+ * Function: cvm_stats_dump
+ * Usage: cvm_stats_dump(stderr)
+ * -----------------------------
+ * Prints the counts, and the calls and cycles per probed function if they
+ * were timed, to fp. Prints nothing if the library was built without
+ * CVM_STATS.
+ */
+void cvm_stats_dump(FILE *fp);
+
+
+/**
+ * Function: cvm_stats_reset
+ * Usage: cvm_stats_reset()
+ * ------------------------
+ * Zeroes all counts, e.g. to measure one phase of a program by itself.
+ */
+void cvm_stats_reset(void);
+
+#endif
@@ -9,13 +9,69 @@
 #include <stdio.h>
 #include "cmap.h"
 #include "cvector.h"
+#include "cvmstats.h"
+#include "../assign7/allocator.h"
+#include "../assign7/segment.h"
+#include <malloc.h>
 #include <stdlib.h>
 #include <string.h>
 #include <error.h>
+#include <time.h>
+#include <unistd.h>
 
 #define NUM_SYNONYMS 16
 #define NUM_HEADWORDS 35000
 
+/**
+ * With -a, every container and string is allocated through a CAllocator
+ * that passes requests on to malloc or to mymalloc and tracks the bytes
+ * in use, so the two heaps can be compared on the same workload.
+ */
+typedef struct {
+    const CAllocator *heap;  // allocator requests are passed to
+    size_t live, peak;       // payload bytes in use, and the most ever
+} countingHeap;
+
+static const CAllocator *allocator; // NULL to use malloc and an arena
+
+static void *count_alloc(void *context, size_t size)
+{
+    countingHeap *ch = context;
+    if ((ch->live += size) > ch->peak) ch->peak = ch->live;
+    return ch->heap->alloc(ch->heap->context, size);
+}
+
+static void *count_realloc(void *context, void *ptr, size_t oldsize, size_t size)
+{
+    countingHeap *ch = context;
+    if ((ch->live += size - oldsize) > ch->peak) ch->peak = ch->live;
+    return ch->heap->realloc(ch->heap->context, ptr, oldsize, size);
+}
+
+static void count_free(void *context, void *ptr, size_t size)
+{
+    countingHeap *ch = context;
+    ch->live -= size;
+    ch->heap->free(ch->heap->context, ptr, size);
+}
+
+static void *my_alloc(void *context, size_t size)
+{
+    return mymalloc(size);
+}
+
+static void *my_realloc(void *context, void *ptr, size_t oldsize, size_t size)
+{
+    return myrealloc(ptr, size);
+}
+
+static void my_free(void *context, void *ptr, size_t size)
+{
+    myfree(ptr);
+}
+
+static const CAllocator mymalloc_allocator = {my_alloc, my_realloc, my_free, NULL};
+
 static void cleanup_cvec(void *p)
 {
     cvec_dispose(*(CVector **)p);
@@ -23,7 +79,24 @@ static void cleanup_cvec(void *p)
 
 static void cleanup_str(void *p)
 {
-    free(*(char **)p);
+    char *s = *(char **)p;
+    if (allocator == NULL) free(s);
+    else allocator->free(allocator->context, s, strlen(s) + 1);
+}
+
+static char *copy_str(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *copy = (allocator == NULL) ? malloc(len) : allocator->alloc(allocator->context, len);
+    if (copy == NULL) error(1, 0, "Out of memory copying \"%s\"", s);
+    return memcpy(copy, s, len);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 /**
@@ -41,6 +114,9 @@ static bool read_line(FILE *fp, char *buf, int sz)
 
 /**
  * Tokenizes thesaurus data file and builds map of word -> synonyms.
+ * The synonym CVectors all live in the given arena, so they are released
+ * together when the arena is disposed, unless an allocator is in use, in
+ * which case everything comes from the allocator.
  * Each line of data file is expected to be of the form:
  *
  *     cold,arctic,blustery,freezing,frigid,icy,nippy,polar
@@ -48,9 +124,10 @@ static bool read_line(FILE *fp, char *buf, int sz)
  * The first word (or phrase) is primary, and rest of line are synonyms of first.
  * The ',' delimits words, and the '\n' marks the end of the entry.
  */
-static CMap *read_thesaurus(FILE *fp)
+static CMap *read_thesaurus(FILE *fp, CArena *arena)
 {
-    CMap *thesaurus = cmap_create(sizeof(CVector *), NUM_HEADWORDS, cleanup_cvec);
+    CMap *thesaurus = allocator ? cmap_create_ex(allocator, sizeof(CVector *), NUM_HEADWORDS, cleanup_cvec)
+                                : cmap_create(sizeof(CVector *), NUM_HEADWORDS, cleanup_cvec);
     printf("Loading thesaurus..");
     fflush(stdout);
 
@@ -63,10 +140,11 @@ static CMap *read_thesaurus(FILE *fp)
         char *cur = line;
         sscanf(line, "%127[^,]", buffer);   // first word of line is headword
         cur += strlen(buffer);
-        CVector *synonyms = cvec_create(sizeof(char *), NUM_SYNONYMS, cleanup_str);
+        CVector *synonyms = allocator ? cvec_create_ex(allocator, sizeof(char *), NUM_SYNONYMS, cleanup_str)
+                                      : cvec_create_in(arena, sizeof(char *), NUM_SYNONYMS, cleanup_str);
         cmap_put(thesaurus, buffer, &synonyms);
         while (sscanf(cur, ",%127[^,]", buffer) == 1) { // all subsequent words are synonyms
-            char *synonym = strdup(buffer);
+            char *synonym = copy_str(buffer);
             cvec_append(synonyms, &synonym);
             cur += strlen(buffer) + 1;
         }
@@ -104,14 +182,55 @@ static void query(CMap *thesaurus)
     }
 }
 
+/**
+ * Reports how long loading and disposing took on the chosen heap, the
+ * peak payload the containers had in use, and the heap footprint at that
+ * point. Nothing is freed while loading, so the footprint after loading
+ * is the peak footprint.
+ */
+static void report_heap(const char *name, const countingHeap *ch, double load_secs, double dispose_secs, size_t footprint)
+{
+    fprintf(stderr, "%s: load %.3f secs, dispose %.3f secs, peak payload %zu bytes, "
+            "heap %zu bytes, utilization %.1f%%\n", name, load_secs, dispose_secs,
+            ch->peak, footprint, 100.0 * ch->peak / footprint);
+}
+
 int main(int argc, char *argv[])
 {
-    const char *filename = (argc == 1) ? "/afs/ir/class/cs107/samples/assign3/thesaurus.txt" : argv[1];
+    const char *heapname = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:")) != -1) {
+        if (opt == 'a') heapname = optarg;
+        else error(1, 0, "Usage: thesaurus [-a malloc|mymalloc] [thesaurus file]");
+    }
+    countingHeap ch = {NULL, 0, 0};
+    CAllocator counting = {count_alloc, count_realloc, count_free, &ch};
+    if (heapname != NULL) {
+        if (strcmp(heapname, "malloc") == 0) ch.heap = &callocator_malloc;
+        else if (strcmp(heapname, "mymalloc") == 0 && myinit()) ch.heap = &mymalloc_allocator;
+        else error(1, 0, "Unknown heap \"%s\", expected malloc or mymalloc", heapname);
+        allocator = &counting;
+    }
+    const char *filename = (optind == argc) ? "/afs/ir/class/cs107/samples/assign3/thesaurus.txt" : argv[optind];
     FILE *fp = fopen(filename, "r");
     if (fp == NULL) error(1, 0,"Could not open thesaurus file named \"%s\"", filename);
-    CMap *thesaurus = read_thesaurus(fp);
+    CArena *arena = carena_create(0);
+    double start = now();
+    CMap *thesaurus = read_thesaurus(fp, arena);
+    double load_secs = now() - start;
+    cvm_stats_dump(stderr); // what loading cost, in a CVM_STATS build
+    size_t footprint = 0;
+    // like mallinfo2's hblkhd, count large blocks given regions of their own
+    if (ch.heap == &mymalloc_allocator) footprint = heap_segment_size() + mapped_region_size();
+    else if (ch.heap != NULL) {
+        struct mallinfo2 mi = mallinfo2();
+        footprint = mi.arena + mi.hblkhd;
+    }
     query(thesaurus);
+    start = now();
     cmap_dispose(thesaurus);
+    carena_dispose(arena);
+    if (heapname != NULL) report_heap(heapname, &ch, load_secs, now() - start, footprint);
     return 0;
 }
 
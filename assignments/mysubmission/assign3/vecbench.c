@@ -0,0 +1,760 @@
+/* File: vecbench.c
+ * ----------------
+ * A program that times CVector operations on large synthetic workloads so
+ * alternative implementations can be compared side by side. Each benchmark
+ * prints one line per variant with the elapsed wall-clock time.
+ * Usage: ./vecbench [number of elements] [benchmark name]
+ * With no benchmark name, every benchmark is run.
+ */
+
+#include "cvector.h"
+#include "csegvector.h"
+#include "cdeque.h"
+#include "cheap.h"
+#include "cstrvec.h"
+#include "cconcvec.h"
+#include "cvector_template.h"
+#include <error.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_NELEMS 1000000
+
+/* Function: now
+ * -------------
+ * Returns a monotonic timestamp in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *bench, const char *variant, int n, double secs)
+{
+    printf("%-28s %-22s %10d elems %10.4f secs\n", bench, variant, n, secs);
+}
+
+static void report_mb(const char *bench, const char *variant, int n, size_t bytes)
+{
+    printf("%-28s %-22s %10d elems %10.1f MB\n", bench, variant, n, bytes / 1048576.0);
+}
+
+// bytes of resident memory, from /proc/self/statm
+static size_t resident(void)
+{
+    size_t pages = 0, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%zu %zu", &pages, &rss) != 2) rss = 0;
+        fclose(fp);
+    }
+    return rss * 4096;
+}
+
+static void cleanup_str(void *p)
+{
+    free(*(char **)p);
+}
+
+/* Function: rand64
+ * ----------------
+ * Returns a pseudo-random 64-bit value assembled from rand() calls.
+ */
+static uint64_t rand64(void)
+{
+    uint64_t val = 0;
+    for (int i = 0; i < 4; i++) val = (val << 16) ^ (rand() & 0xffff);
+    return val;
+}
+
+static int cmp_ino(const void *addr1, const void *addr2)
+{
+    if (*(uint64_t *)addr1 < *(uint64_t *)addr2) return -1;
+    if (*(uint64_t *)addr1 > *(uint64_t *)addr2) return 1;
+    return 0;
+}
+
+static uint64_t ino_key(const void *addr)
+{
+    return *(uint64_t *)addr;
+}
+
+// same ordering as searchdir's cmp_path: by length, then lexicographic
+static int cmp_pathstr(const char *path1, const char *path2)
+{
+    size_t len1 = strlen(path1), len2 = strlen(path2);
+    if (len1 != len2) return len1 < len2 ? -1 : 1;
+    return strcmp(path1, path2);
+}
+
+static int cmp_path(const void *addr1, const void *addr2)
+{
+    return cmp_pathstr(*(char **)addr1, *(char **)addr2);
+}
+
+static const char *path_key(const void *addr, size_t *plen)
+{
+    *plen = strlen(*(char **)addr);
+    return *(char **)addr;
+}
+
+/* Function: make_paths
+ * --------------------
+ * Fills a CVector with n heap-allocated path strings that look like the
+ * output of a directory walk: a few levels of shared directory prefixes
+ * followed by a file name.
+ */
+static CVector *make_paths(int n)
+{
+    static const char *dirs[] = {"usr", "lib", "share", "src", "include", "home", "doc", "bin"};
+    int ndirs = sizeof(dirs)/sizeof(dirs[0]);
+    CVector *paths = cvec_create(sizeof(char *), n, cleanup_str);
+    for (int i = 0; i < n; i++) {
+        char buf[128];
+        int len = 0;
+        for (int depth = rand() % 4 + 1; depth > 0; depth--)
+            len += sprintf(buf + len, "/%s", dirs[rand() % ndirs]);
+        sprintf(buf + len, "/file%d.c", rand() % n);
+        char *path = strdup(buf);
+        cvec_append(paths, &path);
+    }
+    return paths;
+}
+
+static CVector *copy_of(const CVector *cv, size_t elemsz)
+{
+    CVector *copy = cvec_create(elemsz, cvec_count(cv), NULL);
+    for (void *cur = cvec_first(cv); cur != NULL; cur = cvec_next(cv, cur))
+        cvec_append(copy, cur);
+    return copy;
+}
+
+/* Function: bench_sort
+ * --------------------
+ * Sorts identical copies of u64 inode numbers and of path strings with
+ * cvec_sort (CompareFn) and with the key-extracting radix sorts.
+ */
+static void bench_sort(int n)
+{
+    CVector *inodes = cvec_create(sizeof(uint64_t), n, NULL);
+    for (int i = 0; i < n; i++) {
+        uint64_t ino = rand64() >> 24;  // inode-like magnitudes, 40 bits
+        cvec_append(inodes, &ino);
+    }
+    CVector *copy = copy_of(inodes, sizeof(uint64_t));
+    double start = now();
+    cvec_sort(copy, cmp_ino);
+    report("sort u64 inodes", "cvec_sort", n, now() - start);
+    cvec_dispose(copy);
+    copy = copy_of(inodes, sizeof(uint64_t));
+    start = now();
+    cvec_sort_by_key(copy, ino_key);
+    report("sort u64 inodes", "cvec_sort_by_key", n, now() - start);
+    cvec_dispose(copy);
+    cvec_dispose(inodes);
+
+    CVector *paths = make_paths(n);
+    copy = copy_of(paths, sizeof(char *));
+    start = now();
+    cvec_sort(copy, cmp_path);
+    report("sort path strings", "cvec_sort", n, now() - start);
+    cvec_dispose(copy);
+    copy = copy_of(paths, sizeof(char *));
+    start = now();
+    cvec_sort_by_strkey(copy, path_key);
+    report("sort path strings", "cvec_sort_by_strkey", n, now() - start);
+    cvec_dispose(copy);
+    cvec_dispose(paths);
+}
+
+/* Function: bench_arena
+ * ---------------------
+ * Builds many small vectors of varying length the way thesaurus does, once
+ * with each vector on the heap and once with all of them in one CArena.
+ * Times building and tearing down separately.
+ */
+static void bench_arena(int n)
+{
+    int nvecs = n / 10 > 0 ? n / 10 : 1;
+    int *lengths = malloc(nvecs * sizeof(int));
+    for (int i = 0; i < nvecs; i++) lengths[i] = rand() % 20 + 1; // mean ~10 elems
+    CVector **vecs = malloc(nvecs * sizeof(CVector *));
+
+    double start = now();
+    for (int i = 0; i < nvecs; i++) {
+        vecs[i] = cvec_create(sizeof(char *), 16, NULL);
+        for (int j = 0; j < lengths[i]; j++) cvec_append(vecs[i], &vecs[i]);
+    }
+    report("build small vectors", "heap", nvecs, now() - start);
+    start = now();
+    for (int i = 0; i < nvecs; i++) cvec_dispose(vecs[i]);
+    report("dispose small vectors", "heap", nvecs, now() - start);
+
+    start = now();
+    CArena *arena = carena_create(0);
+    for (int i = 0; i < nvecs; i++) {
+        vecs[i] = cvec_create_in(arena, sizeof(char *), 16, NULL);
+        for (int j = 0; j < lengths[i]; j++) cvec_append(vecs[i], &vecs[i]);
+    }
+    report("build small vectors", "arena", nvecs, now() - start);
+    start = now();
+    carena_dispose(arena);
+    report("dispose small vectors", "arena", nvecs, now() - start);
+    free(vecs);
+    free(lengths);
+}
+
+// cheap pseudo-random index sequence, so lookups aren't timing rand()
+static inline uint32_t next_index(uint32_t *state, int n)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state % n;
+}
+
+/* Function: bench_capacity
+ * ------------------------
+ * Appends n u32 elements one at a time, then does n random cvec_nth reads,
+ * for a vector kept on the heap, one that moves to huge-page storage, and
+ * one reserved up front.
+ */
+static void bench_capacity(int n)
+{
+    static const struct { const char *name; size_t huge_threshold; bool reserve; } variants[] = {
+        {"heap realloc", 0, false},
+        {"huge-page mremap", 32 << 20, false},
+        {"huge-page reserved", 32 << 20, true},
+    };
+    for (int v = 0; v < sizeof(variants)/sizeof(variants[0]); v++) {
+        double start = now();
+        CVector *cv = cvec_create(sizeof(uint32_t), 0, NULL);
+        cvec_set_growth(cv, 2.0, variants[v].huge_threshold);
+        if (variants[v].reserve) cvec_reserve(cv, n);
+        for (uint32_t i = 0; i < n; i++)
+            cvec_append(cv, &i);
+        report("append u32", variants[v].name, n, now() - start);
+
+        uint32_t state = 107, sum = 0;
+        start = now();
+        for (int i = 0; i < n; i++)
+            sum += *(uint32_t *)cvec_nth(cv, next_index(&state, n));
+        report("random cvec_nth", variants[v].name, n, now() - start);
+        if (sum == 0) printf("(unlikely zero sum)\n"); // keep the reads live
+        cvec_dispose(cv);
+    }
+}
+
+/* Function: bench_segvec
+ * -----------------------
+ * Appends n u64 elements to a CVector and to a CSegVector, reporting total
+ * time and the slowest single append, which for the CVector is the final
+ * regrow copying everything stored so far. Then times n random reads.
+ */
+static void bench_segvec(int n)
+{
+    double start = now(), slowest = 0;
+    CVector *cv = cvec_create(sizeof(uint64_t), 0, NULL);
+    cvec_set_growth(cv, 2.0, 0); // plain realloc, the copying case
+    for (uint64_t i = 0; i < n; i++) {
+        double t = now();
+        cvec_append(cv, &i);
+        t = now() - t;
+        if (t > slowest) slowest = t;
+    }
+    report("append u64", "cvec", n, now() - start);
+    report("slowest single append", "cvec", n, slowest);
+
+    start = now();
+    slowest = 0;
+    CSegVector *sv = csegvec_create(sizeof(uint64_t), 0, NULL);
+    for (uint64_t i = 0; i < n; i++) {
+        double t = now();
+        csegvec_append(sv, &i);
+        t = now() - t;
+        if (t > slowest) slowest = t;
+    }
+    report("append u64", "csegvec", n, now() - start);
+    report("slowest single append", "csegvec", n, slowest);
+
+    uint32_t state = 107;
+    uint64_t sum = 0;
+    start = now();
+    for (int i = 0; i < n; i++)
+        sum += *(uint64_t *)cvec_nth(cv, next_index(&state, n));
+    report("random nth", "cvec", n, now() - start);
+    state = 107;
+    start = now();
+    for (int i = 0; i < n; i++)
+        sum -= *(uint64_t *)csegvec_nth(sv, next_index(&state, n));
+    report("random nth", "csegvec", n, now() - start);
+    if (sum != 0) printf("(mismatched reads)\n");
+    cvec_dispose(cv);
+    csegvec_dispose(sv);
+}
+
+#define CMP_U64(a, b) (((a) > (b)) - ((a) < (b)))
+CVECTOR_DEFINE(U64Vec, uint64_t, CMP_U64)
+
+/* Function: bench_template
+ * ------------------------
+ * Runs the same append, random read, sort and binary search workload on
+ * u64 elements through the generic cvec_ functions and through a typed
+ * vector from cvector_template.h.
+ */
+static void bench_template(int n)
+{
+    uint64_t *vals = malloc(n * sizeof(uint64_t));
+    for (int i = 0; i < n; i++) vals[i] = rand64() >> 24;
+
+    double start = now();
+    CVector *cv = cvec_create(sizeof(uint64_t), 0, NULL);
+    for (int i = 0; i < n; i++) cvec_append(cv, &vals[i]);
+    report("append u64", "cvec", n, now() - start);
+    start = now();
+    U64Vec *tv = U64Vec_create(0);
+    for (int i = 0; i < n; i++) U64Vec_append(tv, vals[i]);
+    report("append u64", "typed", n, now() - start);
+
+    uint32_t state = 107;
+    uint64_t sum = 0;
+    start = now();
+    for (int i = 0; i < n; i++) sum += *(uint64_t *)cvec_nth(cv, next_index(&state, n));
+    report("random nth", "cvec", n, now() - start);
+    state = 107;
+    start = now();
+    for (int i = 0; i < n; i++) sum -= *U64Vec_nth(tv, next_index(&state, n));
+    report("random nth", "typed", n, now() - start);
+    if (sum != 0) printf("(mismatched reads)\n");
+
+    start = now();
+    cvec_sort(cv, cmp_ino);
+    report("sort u64", "cvec_sort", n, now() - start);
+    start = now();
+    U64Vec_sort(tv);
+    report("sort u64", "typed introsort", n, now() - start);
+
+    int hits = 0;
+    start = now();
+    for (int i = 0; i < n; i++) hits += cvec_search(cv, &vals[i], cmp_ino, 0, true) != -1;
+    report("binary search u64", "cvec_search", n, now() - start);
+    start = now();
+    for (int i = 0; i < n; i++) hits -= U64Vec_search(tv, vals[i]) != -1;
+    report("binary search u64", "typed", n, now() - start);
+    if (hits != 0) printf("(mismatched searches)\n");
+    cvec_dispose(cv);
+    U64Vec_dispose(tv);
+    free(vals);
+}
+
+/* Function: bench_deque
+ * ---------------------
+ * Inserts u32 elements at the front of a CVector and of a CDeque, then
+ * drains the CDeque as a FIFO queue. Front insertion into the CVector is
+ * quadratic, so that variant is capped at 100000 elements.
+ */
+static void bench_deque(int n)
+{
+    int nvec = n < 100000 ? n : 100000;
+    double start = now();
+    CVector *cv = cvec_create(sizeof(uint32_t), 0, NULL);
+    for (uint32_t i = 0; i < nvec; i++) cvec_insert(cv, &i, 0);
+    report("insert at front u32", "cvec_insert", nvec, now() - start);
+    cvec_dispose(cv);
+
+    start = now();
+    CDeque *cd = cdeque_create(sizeof(uint32_t), 0, NULL);
+    for (uint32_t i = 0; i < n; i++) cdeque_push_front(cd, &i);
+    report("insert at front u32", "cdeque_push_front", n, now() - start);
+    start = now();
+    uint32_t val, sum = 0;
+    while (cdeque_count(cd) > 0) {
+        cdeque_pop_back(cd, &val);
+        sum += val;
+    }
+    report("drain FIFO u32", "cdeque_pop_back", n, now() - start);
+    if (sum == 0 && n > 1) printf("(unlikely zero sum)\n");
+    cdeque_dispose(cd);
+}
+
+static int cmp_ino_desc(const void *addr1, const void *addr2)
+{
+    return cmp_ino(addr2, addr1);
+}
+
+/* Function: bench_topk
+ * --------------------
+ * Finds the 100 smallest of n u64 values three ways: sorting everything,
+ * cvec_topk in place, and streaming through a bounded CHeap of 100 (a
+ * max-heap via the reversed comparison, so it keeps the smallest).
+ */
+static void bench_topk(int n)
+{
+    int k = n < 100 ? n : 100;
+    CVector *vals = cvec_create(sizeof(uint64_t), n, NULL);
+    for (int i = 0; i < n; i++) {
+        uint64_t val = rand64();
+        cvec_append(vals, &val);
+    }
+    CVector *copy = copy_of(vals, sizeof(uint64_t));
+    double start = now();
+    cvec_sort(copy, cmp_ino);
+    report("smallest 100 u64", "cvec_sort", n, now() - start);
+    uint64_t expect = *(uint64_t *)cvec_nth(copy, k - 1);
+    cvec_dispose(copy);
+
+    copy = copy_of(vals, sizeof(uint64_t));
+    start = now();
+    cvec_topk(copy, k, cmp_ino);
+    report("smallest 100 u64", "cvec_topk", n, now() - start);
+    if (*(uint64_t *)cvec_nth(copy, k - 1) != expect) printf("(cvec_topk mismatch)\n");
+    cvec_dispose(copy);
+
+    start = now();
+    CHeap *h = cheap_create(sizeof(uint64_t), k, cmp_ino_desc, NULL);
+    for (void *cur = cvec_first(vals); cur != NULL; cur = cvec_next(vals, cur))
+        cheap_push_bounded(h, cur, k);
+    report("smallest 100 u64", "cheap_push_bounded", n, now() - start);
+    if (*(uint64_t *)cheap_peek(h) != expect) printf("(cheap mismatch)\n");
+    cheap_dispose(h);
+    cvec_dispose(vals);
+}
+
+/* Function: bench_strvec
+ * -----------------------
+ * Stores n paths as a CVector of strdup'ed char * and as a CStrVec, and
+ * reports the resident memory each adds and the time to sort it. Resident
+ * rather than malloc'ed bytes are compared because a large CStrVec blob
+ * moves to huge-page storage outside malloc. The CStrVec is
+ * built first so its RSS growth is not hidden by pages freed from the
+ * other one.
+ */
+static void bench_strvec(int n)
+{
+    CVector *paths = make_paths(n); // source strings, not counted
+    size_t rss = resident();
+    double start = now();
+    CStrVec *sv = cstrvec_create(n, 0);
+    for (void *cur = cvec_first(paths); cur != NULL; cur = cvec_next(paths, cur))
+        cstrvec_append(sv, *(char **)cur);
+    report("build path strings", "cstrvec", n, now() - start);
+    report_mb("rss growth for path strings", "cstrvec", n, resident() - rss);
+
+    rss = resident();
+    start = now();
+    CVector *cv = cvec_create(sizeof(char *), n, cleanup_str);
+    for (void *cur = cvec_first(paths); cur != NULL; cur = cvec_next(paths, cur)) {
+        char *copy = strdup(*(char **)cur);
+        cvec_append(cv, &copy);
+    }
+    report("build path strings", "cvec of strdup", n, now() - start);
+    report_mb("rss growth for path strings", "cvec of strdup", n, resident() - rss);
+
+    start = now();
+    cvec_sort(cv, cmp_path);
+    report("sort path strings", "cvec of strdup", n, now() - start);
+    start = now();
+    cstrvec_sort(sv, cmp_pathstr);
+    report("sort path strings", "cstrvec", n, now() - start);
+    if (strcmp(*(char **)cvec_nth(cv, n / 2), cstrvec_nth(sv, n / 2)) != 0) printf("(mismatched sort)\n");
+
+    start = now();
+    cvec_dispose(cv);
+    report("dispose path strings", "cvec of strdup", n, now() - start);
+    start = now();
+    cstrvec_dispose(sv);
+    report("dispose path strings", "cstrvec", n, now() - start);
+    cvec_dispose(paths);
+}
+
+/* Function: bench_index
+ * ---------------------
+ * Runs 1M membership queries (about half present) against n sorted u64
+ * keys with cvec_search's bsearch and with a cvec_build_index index.
+ */
+static void bench_index(int n)
+{
+    int nqueries = 1000000;
+    CVector *cv = cvec_create(sizeof(uint64_t), n, NULL);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t val = 2 * i;
+        cvec_append(cv, &val);
+    }
+    uint64_t *queries = malloc(nqueries * sizeof(uint64_t));
+    uint32_t state = 107;
+    for (int i = 0; i < nqueries; i++) queries[i] = next_index(&state, n) * 2 + (i & 1);
+
+    int found = 0;
+    double start = now();
+    for (int i = 0; i < nqueries; i++) found += cvec_search(cv, &queries[i], cmp_ino, 0, true) != -1;
+    report("1M sorted lookups", "bsearch", n, now() - start);
+    start = now();
+    CVecIndex *idx = cvec_build_index(cv, ino_key);
+    report("build index", "eytzinger", n, now() - start);
+    start = now();
+    for (int i = 0; i < nqueries; i++) found -= cvec_index_search(idx, queries[i]) != -1;
+    report("1M sorted lookups", "eytzinger", n, now() - start);
+    if (found != 0) printf("(mismatched lookups)\n");
+    cvec_index_dispose(idx);
+    free(queries);
+    cvec_dispose(cv);
+}
+
+static int cmp_u32(const void *addr1, const void *addr2)
+{
+    uint32_t val1 = *(uint32_t *)addr1, val2 = *(uint32_t *)addr2;
+    return (val1 > val2) - (val1 < val2);
+}
+
+// sorted distinct random values of elemsz bytes, about n of them below 4n
+static CVector *random_set(size_t elemsz, int n)
+{
+    CVector *cv = cvec_create(elemsz, n, NULL);
+    for (int i = 0; i < n; i++) {
+        uint64_t val = rand64() % (4 * (uint64_t)n);
+        uint32_t val32 = val;
+        cvec_append(cv, elemsz == sizeof(uint32_t) ? (void *)&val32 : (void *)&val);
+    }
+    cvec_sort(cv, elemsz == sizeof(uint32_t) ? cmp_u32 : cmp_ino);
+    cvec_unique(cv, NULL);
+    return cv;
+}
+
+/* Function: bench_sets
+ * --------------------
+ * Intersects two sorted sets of about n random u32 and u64 values, by a
+ * cvec_search per element (the hand-rolled way), by cvec_intersect with a
+ * CompareFn, and by cvec_intersect with the built-in fast path. Then does
+ * the same for a set 1000 times smaller against the large one, where
+ * cvec_intersect gallops.
+ */
+static void bench_sets(int n)
+{
+    for (size_t elemsz = 4; elemsz <= 8; elemsz += 4) {
+        CompareFn cmp = elemsz == sizeof(uint32_t) ? cmp_u32 : cmp_ino;
+        const char *bench = elemsz == sizeof(uint32_t) ? "intersect u32" : "intersect u64";
+        const char *skewed = elemsz == sizeof(uint32_t) ? "intersect u32 n/1000 vs n" : "intersect u64 n/1000 vs n";
+        CVector *a = random_set(elemsz, n), *b = random_set(elemsz, n), *small = random_set(elemsz, n / 1000 + 1);
+        for (int pass = 0; pass < 2; pass++) {
+            const CVector *first = pass == 0 ? a : small;
+            CVector *out = cvec_create(elemsz, 0, NULL);
+            double start = now();
+            for (void *cur = cvec_first(first); cur != NULL; cur = cvec_next(first, cur))
+                if (cvec_search(b, cur, cmp, 0, true) != -1) cvec_append(out, cur);
+            report(pass == 0 ? bench : skewed, "cvec_search each", n, now() - start);
+            int expect = cvec_count(out);
+            cvec_dispose(out);
+
+            out = cvec_create(elemsz, 0, NULL);
+            start = now();
+            cvec_intersect(first, b, out, cmp);
+            report(pass == 0 ? bench : skewed, "cvec_intersect cmp", n, now() - start);
+            if (cvec_count(out) != expect) printf("(mismatched intersection)\n");
+            cvec_dispose(out);
+
+            out = cvec_create(elemsz, 0, NULL);
+            start = now();
+            cvec_intersect(first, b, out, NULL);
+            report(pass == 0 ? bench : skewed, "cvec_intersect NULL", n, now() - start);
+            if (cvec_count(out) != expect) printf("(mismatched intersection)\n");
+            cvec_dispose(out);
+        }
+        CVector *out = cvec_create(elemsz, 0, NULL);
+        double start = now();
+        cvec_union(a, b, out, NULL);
+        report(elemsz == sizeof(uint32_t) ? "union u32" : "union u64", "cvec_union NULL", n, now() - start);
+        cvec_dispose(out);
+        cvec_dispose(a);
+        cvec_dispose(b);
+        cvec_dispose(small);
+    }
+}
+
+// what each appending thread in bench_concvec is told
+typedef struct {
+    CConcVec *cv;
+    CVector *locked;
+    pthread_mutex_t *lock;
+    int nelems;
+} appendJob;
+
+static void *append_concvec(void *data)
+{
+    appendJob *job = data;
+    for (uint64_t i = 0; i < job->nelems; i++) cconcvec_append(job->cv, &i);
+    return NULL;
+}
+
+static void *append_locked(void *data)
+{
+    appendJob *job = data;
+    for (uint64_t i = 0; i < job->nelems; i++) {
+        pthread_mutex_lock(job->lock);
+        cvec_append(job->locked, &i);
+        pthread_mutex_unlock(job->lock);
+    }
+    return NULL;
+}
+
+/* Function: bench_concvec
+ * -----------------------
+ * Splits n u64 appends over 1, 2, 4 and 8 threads, into one CConcVec and
+ * into one CVector guarded by a mutex.
+ */
+static void bench_concvec(int n)
+{
+    for (int nthreads = 1; nthreads <= 8; nthreads *= 2) {
+        pthread_t threads[8];
+        appendJob jobs[8];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char variant[32];
+        for (int locked = 0; locked < 2; locked++) {
+            CConcVec *cv = cconcvec_create(sizeof(uint64_t), 0, NULL);
+            CVector *lv = cvec_create(sizeof(uint64_t), 0, NULL);
+            double start = now();
+            for (int t = 0; t < nthreads; t++) {
+                jobs[t] = (appendJob){cv, lv, &lock, n / nthreads};
+                pthread_create(&threads[t], NULL, locked ? append_locked : append_concvec, &jobs[t]);
+            }
+            for (int t = 0; t < nthreads; t++) pthread_join(threads[t], NULL);
+            sprintf(variant, "%s x%d threads", locked ? "mutex cvec" : "cconcvec", nthreads);
+            report("concurrent append u64", variant, n / nthreads * nthreads, now() - start);
+            cconcvec_dispose(cv);
+            cvec_dispose(lv);
+        }
+    }
+}
+
+/* Function: bench_serialize
+ * -------------------------
+ * Saves n u64 values to a file and loads them back as text (fprintf and
+ * fscanf, what a pipeline of programs usually does), with cvec_write and
+ * cvec_read, and with cvec_view_mapped, which is summed to touch every
+ * page. The same is done for n path strings, one per line as text and with
+ * cvec_string_serializer. The file is still in the page cache when read.
+ */
+static void bench_serialize(int n)
+{
+    char path[64];
+    sprintf(path, "/tmp/vecbench.%d.bin", getpid());
+    CVector *vals = cvec_create(sizeof(uint64_t), n, NULL);
+    for (int i = 0; i < n; i++) {
+        uint64_t val = rand64();
+        cvec_append(vals, &val);
+    }
+    uint64_t expected = 0;
+    for (void *cur = cvec_first(vals); cur != NULL; cur = cvec_next(vals, cur))
+        expected += *(uint64_t *)cur;
+
+    double start = now();
+    FILE *fp = fopen(path, "w");
+    for (void *cur = cvec_first(vals); cur != NULL; cur = cvec_next(vals, cur))
+        fprintf(fp, "%lu\n", *(uint64_t *)cur);
+    fclose(fp);
+    report("save u64", "text", n, now() - start);
+    start = now();
+    fp = fopen(path, "r");
+    CVector *copy = cvec_create(sizeof(uint64_t), 0, NULL);
+    uint64_t val;
+    while (fscanf(fp, "%lu", &val) == 1)
+        cvec_append(copy, &val);
+    fclose(fp);
+    report("load u64", "text", n, now() - start);
+    cvec_dispose(copy);
+
+    start = now();
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    cvec_write(vals, fd, NULL);
+    close(fd);
+    report("save u64", "cvec_write", n, now() - start);
+    start = now();
+    fd = open(path, O_RDONLY);
+    copy = cvec_read(fd, NULL);
+    close(fd);
+    report("load u64", "cvec_read", n, now() - start);
+    cvec_dispose(copy);
+    start = now();
+    CVector *view = cvec_view_mapped(path);
+    uint64_t sum = 0;
+    for (void *cur = cvec_first(view); cur != NULL; cur = cvec_next(view, cur))
+        sum += *(uint64_t *)cur;
+    report("load and sum u64", "cvec_view_mapped", n, now() - start);
+    if (sum != expected) printf("(mismatched view)\n");
+    cvec_dispose(view);
+    cvec_dispose(vals);
+
+    CVector *paths = make_paths(n);
+    start = now();
+    fp = fopen(path, "w");
+    for (void *cur = cvec_first(paths); cur != NULL; cur = cvec_next(paths, cur))
+        fprintf(fp, "%s\n", *(char **)cur);
+    fclose(fp);
+    report("save path strings", "text", n, now() - start);
+    start = now();
+    fp = fopen(path, "r");
+    copy = cvec_create(sizeof(char *), 0, cleanup_str);
+    char buf[128];
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        buf[strcspn(buf, "\n")] = '\0';
+        char *s = strdup(buf);
+        cvec_append(copy, &s);
+    }
+    fclose(fp);
+    report("load path strings", "text", n, now() - start);
+    cvec_dispose(copy);
+
+    start = now();
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    cvec_write(paths, fd, &cvec_string_serializer);
+    close(fd);
+    report("save path strings", "cvec_write", n, now() - start);
+    start = now();
+    fd = open(path, O_RDONLY);
+    copy = cvec_read(fd, &cvec_string_serializer);
+    close(fd);
+    report("load path strings", "cvec_read", n, now() - start);
+    if (copy == NULL || strcmp(*(char **)cvec_nth(copy, n - 1), *(char **)cvec_nth(paths, n - 1)) != 0)
+        printf("(mismatched strings)\n");
+    if (copy != NULL) cvec_dispose(copy);
+    cvec_dispose(paths);
+    unlink(path);
+}
+
+static const struct {
+    const char *name;
+    void (*fn)(int n);
+} benchmarks[] = {
+    {"sort", bench_sort},
+    {"arena", bench_arena},
+    {"capacity", bench_capacity},
+    {"segvec", bench_segvec},
+    {"template", bench_template},
+    {"deque", bench_deque},
+    {"topk", bench_topk},
+    {"strvec", bench_strvec},
+    {"index", bench_index},
+    {"sets", bench_sets},
+    {"concvec", bench_concvec},
+    {"serialize", bench_serialize},
+};
+
+int main(int argc, char *argv[])
+{
+    int n = (argc > 1) ? atoi(argv[1]) : DEFAULT_NELEMS;
+    if (n <= 0) error(1, 0, "Usage: vecbench [number of elements] [benchmark name]");
+    const char *which = (argc > 2) ? argv[2] : NULL;
+    bool found = false;
+    for (int i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+        if (which == NULL || strcmp(which, benchmarks[i].name) == 0) {
+            benchmarks[i].fn(n);
+            found = true;
+        }
+    }
+    if (!found) error(1, 0, "No benchmark named \"%s\"", which);
+    return 0;
+}
@@ -7,16 +7,27 @@
 */
 
 #include "cvector.h"
+#include "cmap.h"
+#include "csegvector.h"
+#include "cdeque.h"
+#include "cheap.h"
+#include "cstrvec.h"
+#include "cconcvec.h"
+#include "cvmstats.h"
+#include "cvector_template.h"
 #include <error.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 
 // Uncomment this line to test cvec_remove
-//#define ENABLE_CVEC_REMOVE
+#define ENABLE_CVEC_REMOVE
 // Uncomment this line to test cvec_replace
-//#define ENABLE_CVEC_REPLACE
+#define ENABLE_CVEC_REPLACE
 
 
 /* Function: verify_int
@@ -188,9 +199,14 @@ static void large_test(int size)
     printf("cv length %d\n", cvec_count(cv));
     cvec_sort(cv, cmp_int);
     printf("Verifying CVector is in sorted order.\n");
+#ifdef ENABLE_CVEC_REMOVE
+    int step = 2; // only even numbers remain
+#else
+    int step = 1;
+#endif
     for (int i = 0; i < cvec_count(cv); i++) {
-        if (i != *(int *) cvec_nth(cv, i)) {
-            verify_int(i, *(int *) cvec_nth(cv, i), "cvec_nth()");
+        if (i * step != *(int *) cvec_nth(cv, i)) {
+            verify_int(i * step, *(int *) cvec_nth(cv, i), "cvec_nth()");
             break; // stop at first sign of trouble
         }
     }
@@ -199,10 +215,868 @@ static void large_test(int size)
 
 
 
+static uint64_t int_key(const void *p)
+{
+    return (uint64_t)*(int *)p ^ (1ULL << 63); // flip sign bit so negatives sort first
+}
+
+static const char *str_key(const void *p, size_t *plen)
+{
+    *plen = strlen(*(char **)p);
+    return *(char **)p;
+}
+
+static int cmp_len_str(const void *p1, const void *p2)
+{
+    size_t len1 = strlen(*(char **)p1), len2 = strlen(*(char **)p2);
+    if (len1 != len2) return len1 < len2 ? -1 : 1;
+    return strcmp(*(char **)p1, *(char **)p2);
+}
+
+
+/* Function: radix_test
+* ---------------------
+* Sorts ints and strings with the key-extracting radix sorts and checks
+* the results agree with cvec_sort using an equivalent comparator.
+*/
+static void radix_test(int size)
+{
+    printf("\n----------------- Testing radix sort ------------------ \n");
+    CVector *keyed = cvec_create(sizeof(int), size, NULL);
+    CVector *compared = cvec_create(sizeof(int), size, NULL);
+    for (int i = 0; i < size; i++) {
+        int val = rand() - RAND_MAX / 2;
+        cvec_append(keyed, &val);
+        cvec_append(compared, &val);
+    }
+    cvec_sort_by_key(keyed, int_key);
+    cvec_sort(compared, cmp_int);
+    int mismatch = -1;
+    for (int i = 0; i < size && mismatch == -1; i++)
+        if (*(int *)cvec_nth(keyed, i) != *(int *)cvec_nth(compared, i)) mismatch = i;
+    verify_int(-1, mismatch, "First mismatch sorting ints by key");
+    cvec_dispose(keyed);
+    cvec_dispose(compared);
+
+    char *words[] = {"pear", "fig", "apple", "kiwi", "", "plum", "date", "lime", "banana", "fig"};
+    int nwords = sizeof(words)/sizeof(words[0]);
+    keyed = cvec_create(sizeof(char *), nwords, NULL);
+    compared = cvec_create(sizeof(char *), nwords, NULL);
+    for (int i = 0; i < nwords; i++) {
+        cvec_append(keyed, &words[i]);
+        cvec_append(compared, &words[i]);
+    }
+    cvec_sort_by_strkey(keyed, str_key);
+    cvec_sort(compared, cmp_len_str);
+    mismatch = -1;
+    for (int i = 0; i < nwords && mismatch == -1; i++)
+        if (strcmp(*(char **)cvec_nth(keyed, i), *(char **)cvec_nth(compared, i)) != 0) mismatch = i;
+    verify_int(-1, mismatch, "First mismatch sorting strings by (length, bytes)");
+    cvec_dispose(keyed);
+    cvec_dispose(compared);
+
+    // each byte position splits one key off the rest, the deepest MSD case
+    int nlong = 4000;
+    char *block = malloc((size_t)nlong * (nlong + 1));
+    keyed = cvec_create(sizeof(char *), nlong, NULL);
+    for (int i = nlong - 1; i >= 0; i--) {
+        char *str = block + (size_t)i * (nlong + 1);
+        memset(str, 'b', nlong);
+        str[i] = 'a';
+        str[nlong] = '\0';
+        cvec_append(keyed, &str);
+    }
+    cvec_sort_by_strkey(keyed, str_key);
+    mismatch = -1;
+    for (int i = 0; i < nlong && mismatch == -1; i++)
+        if (*(char **)cvec_nth(keyed, i) != block + (size_t)i * (nlong + 1)) mismatch = i;
+    verify_int(-1, mismatch, "First mismatch sorting long keys with shared prefixes");
+    cvec_dispose(keyed);
+    free(block);
+}
+
+
+/* Function: range_test
+* ---------------------
+* Exercises the bulk operations: append_n, insert_range, remove_range and
+* swap_remove, checking count and contents after each.
+*/
+static void range_test()
+{
+    printf("\n----------------- Testing range operations ------------------ \n");
+    int nums[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    CVector *cv = cvec_create(sizeof(int), 0, NULL);
+    cvec_append_n(cv, nums, 10);                     // 0|1|2|...|9
+    cvec_insert_range(cv, nums, 3, 5);               // 0|1|2|3|4|0|1|2|5|...|9
+    verify_int(13, cvec_count(cv), "cvec_count after insert_range");
+    verify_int(2, *(int *)cvec_nth(cv, 7), "*value for cvec_nth(7)");
+    verify_int(5, *(int *)cvec_nth(cv, 8), "*value for cvec_nth(8)");
+    cvec_remove_range(cv, 5, 3);                     // 0|1|2|...|9
+    verify_int(10, cvec_count(cv), "cvec_count after remove_range");
+    verify_int(5, *(int *)cvec_nth(cv, 5), "*value for cvec_nth(5)");
+    cvec_swap_remove(cv, 2);                         // 0|1|9|3|...|8
+    verify_int(9, cvec_count(cv), "cvec_count after swap_remove");
+    verify_int(9, *(int *)cvec_nth(cv, 2), "*value for cvec_nth(2)");
+    cvec_swap_remove(cv, cvec_count(cv) - 1);        // remove last elem
+    verify_int(7, *(int *)cvec_nth(cv, cvec_count(cv) - 1), "*value for last elem");
+    cvec_insert_range(cv, nums, 0, 0);               // empty range is no-op
+    verify_int(8, cvec_count(cv), "cvec_count after empty insert_range");
+    cvec_dispose(cv);
+}
+
+
+/* Function: mapped_test
+* ----------------------
+* Fills a file-backed CVector, disposes it, then reopens the file and
+* checks the elements persisted and that appending continues to work.
+*/
+static void mapped_test(int size)
+{
+    printf("\n----------------- Testing mapped CVector ------------------ \n");
+    char path[64];
+    sprintf(path, "/tmp/vectest.%d.cvec", getpid());
+    unlink(path);
+    CVector *cv = cvec_open_mapped(path, sizeof(int));
+    verify_int(0, cvec_count(cv), "cvec_count of new mapped CVector");
+    for (int i = 0; i < size; i++)
+        cvec_append(cv, &i);
+    cvec_dispose(cv);
+
+    cv = cvec_open_mapped(path, sizeof(int));
+    cvec_advise(cv, CVEC_ADVICE_SEQUENTIAL);
+    verify_int(size, cvec_count(cv), "cvec_count of reopened CVector");
+    int bad = -1;
+    for (int i = 0; i < size && bad == -1; i++)
+        if (*(int *)cvec_nth(cv, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong element after reopen");
+    cvec_append(cv, &size);
+    verify_int(size, *(int *)cvec_nth(cv, size), "*value appended after reopen");
+    cvec_dispose(cv);
+    verify_int(1, cvec_open_mapped(path, sizeof(double)) == NULL, "Reopen with wrong elemsz fails");
+    unlink(path);
+
+    // elements too big for the inline buffer, so storage comes from the file only
+    char big[100];
+    cv = cvec_open_mapped(path, sizeof(big));
+    for (int i = 0; i < 100; i++){
+        memset(big, i, sizeof(big));
+        cvec_append(cv, big);
+    }
+    cvec_dispose(cv);
+    cv = cvec_open_mapped(path, sizeof(big));
+    verify_int(100, cvec_count(cv), "cvec_count of reopened CVector of 100-byte elements");
+    verify_int(99, ((char *)cvec_nth(cv, 99))[sizeof(big) - 1], "Last byte of last 100-byte element");
+    cvec_dispose(cv);
+    unlink(path);
+}
+
+
+/* Function: capacity_test
+* ------------------------
+* Exercises reserve, shrink_to_fit and the growth policy, including moving
+* a vector into huge-page storage and back out again.
+*/
+static void capacity_test(int size)
+{
+    printf("\n----------------- Testing capacity management ------------------ \n");
+    CVector *cv = cvec_create(sizeof(int), 0, NULL);
+    cvec_set_growth(cv, 1.5, 1 << 20);        // huge storage from 1MB up
+    cvec_reserve(cv, size / 2);
+    for (int i = 0; i < size; i++)
+        cvec_append(cv, &i);
+    int bad = -1;
+    for (int i = 0; i < size && bad == -1; i++)
+        if (*(int *)cvec_nth(cv, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong element after growth");
+    cvec_remove_range(cv, 10, size - 10);
+    cvec_shrink_to_fit(cv);                   // back out of huge storage
+    verify_int(10, cvec_count(cv), "cvec_count after shrink_to_fit");
+    verify_int(9, *(int *)cvec_nth(cv, 9), "*value for cvec_nth(9)");
+    cvec_append(cv, &size);
+    verify_int(size, *(int *)cvec_nth(cv, 10), "*value appended after shrink");
+    cvec_dispose(cv);
+}
+
+
+static int ncleaned = 0;
+
+static void count_cleanup(void *p)
+{
+    ncleaned++;
+}
+
+
+/* Function: segvec_test
+ * ----------------------
+ * Runs the basic operations on a CSegVector whose first segment is tiny,
+ * so inserts and removes shift elements across many segment boundaries,
+ * and checks that appends never move an element already stored.
+ */
+static void segvec_test(int size)
+{
+    printf("\n----------------- Testing CSegVector ------------------ \n");
+    CSegVector *sv = csegvec_create(sizeof(int), 1, NULL);
+    for (int i = 0; i < size; i++)
+        csegvec_append(sv, &i);
+    int *first = csegvec_nth(sv, 0), *mid = csegvec_nth(sv, size / 2);
+    for (int i = size; i < 2 * size; i++)
+        csegvec_append(sv, &i);
+    verify_int(2 * size, csegvec_count(sv), "csegvec_count after appends");
+    verify_int(1, first == csegvec_nth(sv, 0) && mid == csegvec_nth(sv, size / 2), "Elements stay put while growing");
+    int bad = -1;
+    for (int i = 0; i < 2 * size && bad == -1; i++)
+        if (*(int *)csegvec_nth(sv, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong element after appends");
+
+    int val = -1;
+    csegvec_insert(sv, &val, 1);
+    csegvec_remove(sv, 2 * size);
+    verify_int(-1, *(int *)csegvec_nth(sv, 1), "*value inserted at index 1");
+    verify_int(2 * size - 2, *(int *)csegvec_nth(sv, 2 * size - 1), "*value at end after insert/remove");
+    csegvec_remove(sv, 1);
+    int count = 0;
+    for (int *cur = csegvec_first(sv); cur != NULL; cur = csegvec_next(sv, cur))
+        if (*cur == count) count++;
+    verify_int(2 * size - 1, count, "Elements in order from first/next");
+
+    for (int i = 0; i < 2 * size - 1; i++) {
+        val = (i * 7919) % (2 * size - 1);
+        csegvec_replace(sv, &val, i);
+    }
+    csegvec_sort(sv, cmp_int);
+    bad = -1;
+    for (int i = 0; i < 2 * size - 1 && bad == -1; i++)
+        if (*(int *)csegvec_nth(sv, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong element after sort");
+    val = size;
+    verify_int(size, csegvec_search(sv, &val, cmp_int, 0, true), "Binary search for size");
+    verify_int(size, csegvec_search(sv, &val, cmp_int, 10, false), "Linear search for size");
+    csegvec_dispose(sv);
+}
+
+#define CMP_INT(a, b) (((a) > (b)) - ((a) < (b)))
+CVECTOR_DEFINE(IntVec, int, CMP_INT)
+
+/* Function: template_test
+ * -----------------------
+ * Fills a typed IntVec with a shuffled permutation, sorts and searches it,
+ * and checks that the same vector works through the generic cvec_ calls.
+ */
+static void template_test(int size)
+{
+    printf("\n----------------- Testing typed vector template ------------------ \n");
+    IntVec *v = IntVec_create(0);
+    for (int i = 0; i < size; i++)
+        IntVec_append(v, (i * 7919) % size);   // 7919 is prime, so a permutation
+    for (int i = 0; i < size; i++)
+        IntVec_append(v, i % 3);               // many duplicates
+    verify_int(2 * size, IntVec_count(v), "IntVec_count after appends");
+    IntVec_sort(v);
+    int bad = -1;
+    for (int i = 1; i < 2 * size && bad == -1; i++)
+        if (*IntVec_nth(v, i - 1) > *IntVec_nth(v, i)) bad = i;
+    verify_int(-1, bad, "First out of order element after IntVec_sort");
+    int found = IntVec_search(v, size / 2);
+    verify_int(size / 2, found == -1 ? -1 : *IntVec_nth(v, found), "*value found by IntVec_search");
+    verify_int(-1, IntVec_search(v, size), "IntVec_search for missing key");
+
+    CVector *cv = IntVec_cvec(v);
+    int key = size / 2;
+    verify_int(2 * size, cvec_count(cv), "cvec_count of typed vector");
+    verify_int(found, cvec_search(cv, &key, cmp_int, 0, true), "cvec_search agrees with IntVec_search");
+    key = size - 1;
+    verify_int(2 * size - 1, cvec_search(cv, &key, cmp_int, 0, true), "cvec_search for largest value");
+    cvec_remove(cv, 0);
+    verify_int(2 * size - 2, IntVec_search(IntVec_from(cv), size - 1), "IntVec_search after cvec_remove");
+    IntVec_dispose(v);
+}
+
+/* Function: deque_test
+ * ---------------------
+ * Pushes at both ends of a CDeque so the ring wraps and grows, checks the
+ * order by index, pops from both ends and copies the rest to a CVector.
+ */
+static void deque_test(int size)
+{
+    printf("\n----------------- Testing CDeque ------------------ \n");
+    CDeque *cd = cdeque_create(sizeof(int), 4, NULL);
+    for (int i = 0; i < size; i++) {
+        int front = -1 - i;
+        cdeque_push_back(cd, &i);
+        cdeque_push_front(cd, &front);
+    }
+    verify_int(2 * size, cdeque_count(cd), "cdeque_count after pushes");
+    int bad = -1;
+    for (int i = 0; i < 2 * size && bad == -1; i++)
+        if (*(int *)cdeque_nth(cd, i) != i - size) bad = i;
+    verify_int(-1, bad, "First wrong element by index");
+    int val;
+    cdeque_pop_front(cd, &val);
+    verify_int(-size, val, "Value popped from front");
+    cdeque_pop_back(cd, &val);
+    verify_int(size - 1, val, "Value popped from back");
+
+    CVector *cv = cvec_create(sizeof(int), 0, NULL);
+    cdeque_copy_to(cd, cv);
+    verify_int(2 * size - 2, cvec_count(cv), "cvec_count after copy_to");
+    bad = -1;
+    for (int i = 0; i < cvec_count(cv) && bad == -1; i++)
+        if (*(int *)cvec_nth(cv, i) != i - size + 1) bad = i;
+    verify_int(-1, bad, "First wrong element copied to CVector");
+    cvec_dispose(cv);
+    cdeque_dispose(cd);
+}
+
+static int cmp_int_desc(const void *p1, const void *p2)
+{
+    return cmp_int(p2, p1);
+}
+
+/* Function: heap_test
+ * -------------------
+ * Pops a heapified permutation in order, streams values through a bounded
+ * CHeap to keep the largest k, and selects the smallest k with cvec_topk.
+ */
+static void heap_test(int size, int k)
+{
+    printf("\n----------------- Testing CHeap and cvec_topk ------------------ \n");
+    CVector *cv = cvec_create(sizeof(int), size, NULL);
+    for (int i = 0; i < size; i++) {
+        int val = (i * 7919) % size;
+        cvec_append(cv, &val);
+    }
+    CHeap *h = cheap_create(sizeof(int), 0, cmp_int, NULL);
+    cheap_heapify(h, cvec_nth(cv, 0), size / 2);
+    for (int i = size / 2; i < size; i++)
+        cheap_push(h, cvec_nth(cv, i));
+    verify_int(0, *(int *)cheap_peek(h), "*value for cheap_peek");
+    int bad = -1, val;
+    for (int i = 0; i < size && bad == -1; i++) {
+        cheap_pop(h, &val);
+        if (val != i) bad = i;
+    }
+    verify_int(-1, bad, "First wrong value popped in order");
+    verify_int(1, cheap_peek(h) == NULL, "Empty after popping all");
+
+    for (int i = 0; i < size; i++)
+        cheap_push_bounded(h, cvec_nth(cv, i), k);
+    verify_int(k, cheap_count(h), "cheap_count after bounded pushes");
+    verify_int(size - k, *(int *)cheap_peek(h), "Least of the k largest on top");
+    cheap_dispose(h);
+
+    cvec_topk(cv, k, cmp_int);
+    bad = -1;
+    for (int i = 0; i < k && bad == -1; i++)
+        if (*(int *)cvec_nth(cv, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong value from cvec_topk");
+    cvec_topk(cv, cvec_count(cv), cmp_int_desc);
+    verify_int(size - 1, *(int *)cvec_nth(cv, 0), "*value first after descending topk of all");
+    verify_int(0, *(int *)cvec_nth(cv, size - 1), "*value last after descending topk of all");
+    cvec_dispose(cv);
+}
+
+/* Function: strvec_test
+ * ----------------------
+ * Appends numbered strings (including an empty one) to a CStrVec, checks
+ * indexing and iteration, sorts them and checks order and contents.
+ */
+static void strvec_test(int size)
+{
+    printf("\n----------------- Testing CStrVec ------------------ \n");
+    CStrVec *sv = cstrvec_create(0, 0);
+    cstrvec_append(sv, "");
+    for (int i = 1; i < size; i++) {
+        char buf[32];
+        sprintf(buf, "str%d", (i * 7919) % size);
+        cstrvec_append(sv, buf);
+    }
+    verify_int(size, cstrvec_count(sv), "cstrvec_count after appends");
+    verify_int(0, strcmp(cstrvec_nth(sv, 1), "str7919"), "strcmp of cstrvec_nth(1)");
+    int count = 0;
+    for (const char *s = cstrvec_first(sv); s != NULL; s = cstrvec_next(sv, s)) {
+        if (s != cstrvec_nth(sv, count)) break;
+        count++;
+    }
+    verify_int(size, count, "Strings visited by first/next");
+    cstrvec_sort(sv, strcmp);
+    verify_int(0, strcmp(cstrvec_nth(sv, 0), ""), "Empty string sorts first");
+    int bad = -1;
+    for (int i = 2; i < size && bad == -1; i++)
+        if (strcmp(cstrvec_nth(sv, i - 1), cstrvec_nth(sv, i)) >= 0) bad = i;
+    verify_int(-1, bad, "First out of order string after sort");
+    count = 0;
+    for (const char *s = cstrvec_first(sv); s != NULL; s = cstrvec_next(sv, s))
+        if (s == cstrvec_nth(sv, count)) count++;
+    verify_int(size, count, "Strings visited in sorted order by first/next");
+    cstrvec_dispose(sv);
+}
+
+/* Function: index_test
+ * --------------------
+ * Builds a search index over a sorted vector with runs of duplicates and
+ * negative values, then checks every present key maps back to its first
+ * occurrence and absent keys are not found.
+ */
+static void index_test(int size)
+{
+    printf("\n----------------- Testing search index ------------------ \n");
+    CVector *cv = cvec_create(sizeof(int), size, NULL);
+    for (int i = 0; i < size; i++) {
+        int val = 2 * (i / 3) - size / 2; // even values, each three times
+        cvec_append(cv, &val);
+    }
+    CVecIndex *idx = cvec_build_index(cv, int_key);
+    int bad = -1;
+    for (int i = 0; i < size && bad == -1; i++)
+        if (cvec_index_search(idx, int_key(cvec_nth(cv, i))) != i / 3 * 3) bad = i;
+    verify_int(-1, bad, "First element not found at its first occurrence");
+    int missing = 0;
+    for (int val = -size / 2 - 3; val < size; val += 2)
+        if (cvec_index_search(idx, int_key(&val)) != -1) missing++;
+    verify_int(0, missing, "Odd keys found by cvec_index_search");
+    int last = *(int *)cvec_nth(cv, size - 1);
+    cvec_dispose(cv);
+    verify_int((size - 1) / 3 * 3, cvec_index_search(idx, int_key(&last)), "Search after CVector disposed");
+    cvec_index_dispose(idx);
+}
+
+// sorted vector of the distinct multiples of step below limit, as elemsz-byte unsigned ints
+static CVector *multiples(size_t elemsz, int step, int limit)
+{
+    CVector *cv = cvec_create(elemsz, 0, NULL);
+    for (uint64_t val = 0; val < limit; val += step) {
+        uint32_t val32 = val;
+        cvec_append(cv, elemsz == sizeof(uint32_t) ? (void *)&val32 : (void *)&val);
+    }
+    return cv;
+}
+
+static uint64_t uint_at(const CVector *cv, int i, size_t elemsz)
+{
+    return elemsz == sizeof(uint32_t) ? *(uint32_t *)cvec_nth(cv, i) : *(uint64_t *)cvec_nth(cv, i);
+}
+
+// counts values below limit in out that are misplaced given which of a, b should hold them
+static int set_errors(const CVector *out, size_t elemsz, int stepa, int stepb, int limit, int op)
+{
+    int errors = 0, n = 0;
+    for (int val = 0; val < limit; val++) {
+        bool ina = val % stepa == 0, inb = val % stepb == 0;
+        bool want = op == 0 ? ina && inb : op == 1 ? ina || inb : ina && !inb;
+        if (want && (n >= cvec_count(out) || uint_at(out, n++, elemsz) != val)) errors++;
+    }
+    return errors + (cvec_count(out) - n);
+}
+
+/* Function: set_test
+ * ------------------
+ * Checks cvec_unique and the set operations on multiples of two steps, for
+ * u32 and u64 elements with the built-in comparison, with skewed sizes
+ * that take the galloping path, and with a client CompareFn.
+ */
+static void set_test(int limit)
+{
+    printf("\n----------------- Testing set operations ------------------ \n");
+    static const char *names[] = {"intersect", "union", "difference"};
+    static const int steps[][2] = {{3, 5}, {5, 3}, {1, 97}, {97, 1}};
+    int errors = 0;
+    for (size_t elemsz = 4; elemsz <= 8; elemsz += 4) {
+        for (int s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+            CVector *a = multiples(elemsz, steps[s][0], limit), *b = multiples(elemsz, steps[s][1], limit);
+            for (int op = 0; op < 3; op++) {
+                CVector *out = cvec_create(elemsz, 0, NULL);
+                if (op == 0) cvec_intersect(a, b, out, NULL);
+                else if (op == 1) cvec_union(a, b, out, NULL);
+                else cvec_difference(a, b, out, NULL);
+                int err = set_errors(out, elemsz, steps[s][0], steps[s][1], limit, op);
+                if (err != 0) printf("%s of steps %d, %d (elemsz %zu) has %d errors\n", names[op], steps[s][0], steps[s][1], elemsz, err);
+                errors += err;
+                cvec_dispose(out);
+            }
+            cvec_dispose(a);
+            cvec_dispose(b);
+        }
+    }
+    verify_int(0, errors, "Wrong values from built-in comparison set operations");
+
+    CVector *a = cvec_create(sizeof(int), 0, NULL), *b = cvec_create(sizeof(int), 0, NULL);
+    for (int i = -limit; i < limit; i++) {
+        if (i % 2 == 0) cvec_append(a, &i);
+        if (i % 3 == 0) { cvec_append(b, &i); cvec_append(b, &i); }
+    }
+    cvec_unique(b, cmp_int);
+    verify_int((2 * limit + 2) / 3, cvec_count(b), "cvec_count after cvec_unique");
+    CVector *out = cvec_create(sizeof(int), 0, NULL);
+    cvec_intersect(a, b, out, cmp_int);
+    int bad = -1;
+    for (int i = 0; i < cvec_count(out) && bad == -1; i++)
+        if (*(int *)cvec_nth(out, i) % 6 != 0) bad = i;
+    verify_int(-1, bad, "First non-multiple of 6 in intersection");
+    int ninter = cvec_count(out);
+    cvec_dispose(out);
+    out = cvec_create(sizeof(int), 0, NULL);
+    cvec_union(a, b, out, cmp_int);
+    verify_int(cvec_count(a) + cvec_count(b) - ninter, cvec_count(out), "cvec_count of union");
+    cvec_dispose(out);
+    out = cvec_create(sizeof(int), 0, NULL);
+    cvec_difference(a, b, out, cmp_int);
+    verify_int(cvec_count(a) - ninter, cvec_count(out), "cvec_count of difference");
+    cvec_dispose(out);
+    cvec_dispose(a);
+    cvec_dispose(b);
+}
+
+#define NTHREADS 4
+
+// what each appending thread in concvec_test is told
+typedef struct {
+    CConcVec *cv;
+    int id, nelems;
+} appenderArgs;
+
+static void *append_values(void *data)
+{
+    appenderArgs *args = data;
+    for (int i = 0; i < args->nelems; i++) {
+        int val = i * NTHREADS + args->id;
+        cconcvec_append(args->cv, &val);
+    }
+    return NULL;
+}
+
+/* Function: concvec_test
+ * ----------------------
+ * Has NTHREADS threads append disjoint values to one CConcVec while this
+ * thread keeps reading everything published so far, then checks every
+ * value arrived exactly once.
+ */
+static void concvec_test(int nelems)
+{
+    printf("\n----------------- Testing CConcVec ------------------ \n");
+    CConcVec *cv = cconcvec_create(sizeof(int), 1, NULL);
+    int total = NTHREADS * nelems;
+    pthread_t threads[NTHREADS];
+    appenderArgs args[NTHREADS];
+    for (int t = 0; t < NTHREADS; t++) {
+        args[t] = (appenderArgs){cv, t, nelems};
+        pthread_create(&threads[t], NULL, append_values, &args[t]);
+    }
+    int bad = 0;
+    while (cconcvec_count(cv) < total) {
+        for (int i = 0, n = cconcvec_count(cv); i < n; i++)
+            if (*(int *)cconcvec_nth(cv, i) < 0 || *(int *)cconcvec_nth(cv, i) >= total) bad++;
+    }
+    for (int t = 0; t < NTHREADS; t++) pthread_join(threads[t], NULL);
+    verify_int(0, bad, "Out of range values read while appending");
+    verify_int(total, cconcvec_count(cv), "cconcvec_count after all appends");
+    char *seen = calloc(total, 1);
+    int missing = total;
+    for (int i = 0; i < total; i++) {
+        int val = *(int *)cconcvec_nth(cv, i);
+        if (!seen[val]) missing--;
+        seen[val] = 1;
+    }
+    verify_int(0, missing, "Values missing after concurrent appends");
+    free(seen);
+    cconcvec_dispose(cv);
+}
+
+/* Function: serialize_test
+ * ------------------------
+ * Writes a CVector to a file and reads it back, checks a corrupted file
+ * is refused, views the file in place, sends a small CVector through a
+ * pipe, and round-trips a CVector of strings with the string serializer.
+ */
+static void serialize_test(int size)
+{
+    printf("\n----------------- Testing CVector serialization ------------------ \n");
+    char path[64];
+    sprintf(path, "/tmp/vectest.%d.bin", getpid());
+    CVector *cv = cvec_create(sizeof(int), size, NULL);
+    for (int i = 0; i < size; i++)
+        cvec_append(cv, &i);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    verify_int(1, cvec_write(cv, fd, NULL), "cvec_write to file");
+    lseek(fd, 0, SEEK_SET);
+    CVector *copy = cvec_read(fd, NULL);
+    verify_int(size, cvec_count(copy), "cvec_count after cvec_read");
+    int bad = -1;
+    for (int i = 0; i < size && bad == -1; i++)
+        if (*(int *)cvec_nth(copy, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong element after cvec_read");
+    cvec_dispose(copy);
+
+    CVector *view = cvec_view_mapped(path);
+    verify_int(size, cvec_count(view), "cvec_count of view");
+    int key = size / 2;
+    verify_int(key, cvec_search(view, &key, cmp_int, 0, true), "cvec_search in view");
+    cvec_dispose(view);
+
+    char flipped = 1;
+    pwrite(fd, &flipped, 1, 64 + size); // a byte in the middle of the elements
+    lseek(fd, 0, SEEK_SET);
+    verify_int(1, cvec_read(fd, NULL) == NULL, "cvec_read of corrupted file fails");
+    ftruncate(fd, 64 + 100);
+    lseek(fd, 0, SEEK_SET);
+    verify_int(1, cvec_read(fd, NULL) == NULL, "cvec_read of truncated elements fails");
+    char header[64];
+    pread(fd, header, sizeof(header), 0);
+    ftruncate(fd, 40);
+    lseek(fd, 0, SEEK_SET);
+    verify_int(1, cvec_read(fd, NULL) == NULL, "cvec_read of truncated header fails");
+    uint64_t oversized[2] = {1ULL << 61, 8}; // elemsz and count, whose product wraps to 0
+    memcpy(header + 8, oversized, sizeof(oversized));
+    pwrite(fd, header, sizeof(header), 0);
+    lseek(fd, 0, SEEK_SET);
+    verify_int(1, cvec_read(fd, NULL) == NULL, "cvec_read of oversized header fails");
+    verify_int(1, cvec_view_mapped(path) == NULL, "cvec_view_mapped of oversized header fails");
+    close(fd);
+    unlink(path);
+
+    int fds[2];
+    pipe(fds);
+    cvec_remove_range(cv, 1000, cvec_count(cv) - 1000); // small enough to fit in the pipe
+    cvec_write(cv, fds[1], NULL);
+    copy = cvec_read(fds[0], NULL);
+    verify_int(1000, copy == NULL ? -1 : cvec_count(copy), "cvec_count after read from pipe");
+    if (copy != NULL) cvec_dispose(copy);
+    cvec_dispose(cv);
+
+    CVector *strs = cvec_create(sizeof(char *), 0, count_cleanup);
+    char *words[] = {"", "apple", "banana split", "cherry"};
+    for (int i = 0; i < 4; i++)
+        cvec_append(strs, &words[i]);
+    cvec_write(strs, fds[1], &cvec_string_serializer);
+    copy = cvec_read(fds[0], &cvec_string_serializer);
+    verify_int(4, cvec_count(copy), "cvec_count of strings read back");
+    bad = -1;
+    for (int i = 0; i < 4 && bad == -1; i++)
+        if (strcmp(*(char **)cvec_nth(copy, i), words[i]) != 0) bad = i;
+    verify_int(-1, bad, "First wrong string after cvec_read");
+    cvec_dispose(copy);
+    cvec_write(strs, fds[1], &cvec_string_serializer);
+    verify_int(1, cvec_read(fds[0], NULL) == NULL, "cvec_read of strings without serializer fails");
+    ncleaned = 0;
+    cvec_dispose(strs);
+    verify_int(4, ncleaned, "Original strings left to their own cleanup fn");
+
+    // the header claims far more than follows, which a pipe cannot reveal up front
+    write(fds[1], header, sizeof(header));
+    verify_int(1, cvec_read(fds[0], NULL) == NULL, "cvec_read of oversized header from pipe fails");
+    oversized[0] = sizeof(int);
+    oversized[1] = 100000000;
+    memcpy(header + 8, oversized, sizeof(oversized));
+    write(fds[1], header, sizeof(header));
+    write(fds[1], header, sizeof(header)); // some of the elements
+    close(fds[1]);
+    verify_int(1, cvec_read(fds[0], NULL) == NULL, "cvec_read of truncated pipe fails");
+    close(fds[0]);
+}
+
+/* Function: stats_test
+ * --------------------
+ * In a CVM_STATS build, checks the counters record a known amount of
+ * work: shifts for inserts at the front, comparator calls for a search,
+ * and hashes and cells for map puts.
+ */
+static void stats_test(void)
+{
+#ifdef CVM_STATS
+    printf("\n----------------- Testing CVM_STATS counters ------------------ \n");
+    cvm_stats_reset();
+    CVector *cv = cvec_create(sizeof(int), 100, NULL);
+    for (int i = 0; i < 10; i++)
+        cvec_insert(cv, &i, 0);
+    verify_int(10, (int)cvm_stats.shifts, "Shifts counted for 10 inserts");
+    verify_int(sizeof(int) * 45, (int)cvm_stats.shift_bytes, "Bytes shifted for 10 inserts");
+    int key = -1;
+    cvec_search(cv, &key, cmp_int, 0, false);
+    verify_int(10, (int)cvm_stats.compares, "Comparator calls for failed linear search");
+    cvec_dispose(cv);
+    CMap *cm = cmap_create(sizeof(int), 0, NULL);
+    int one = 1;
+    cmap_put(cm, "a", &one);
+    cmap_put(cm, "b", &one);
+    cmap_put(cm, "a", &one);
+    verify_int(3, (int)cvm_stats.hashes, "Hashes for 3 puts");
+    verify_int(2, (int)cvm_stats.cells, "Cells allocated for 2 keys");
+    cmap_dispose(cm);
+    cvm_stats_dump(stdout);
+#endif
+}
+
+// a CAllocator context that tracks what is outstanding
+typedef struct {
+    int nblocks;
+    size_t nbytes;
+} allocCounts;
+
+static void *counted_alloc(void *context, size_t size)
+{
+    allocCounts *counts = context;
+    counts->nblocks++;
+    counts->nbytes += size;
+    return malloc(size);
+}
+
+static void *counted_realloc(void *context, void *ptr, size_t oldsize, size_t size)
+{
+    allocCounts *counts = context;
+    counts->nbytes += size - oldsize;
+    return realloc(ptr, size);
+}
+
+static void counted_free(void *context, void *ptr, size_t size)
+{
+    allocCounts *counts = context;
+    counts->nblocks--;
+    counts->nbytes -= size;
+    free(ptr);
+}
+
+/* Function: allocator_test
+ * ------------------------
+ * Runs a CVector and a CMap on a counting CAllocator and checks that all
+ * of their memory went through it, with the sizes given on realloc and
+ * free matching what was allocated, so nothing is outstanding after
+ * dispose.
+ */
+static void allocator_test(int size)
+{
+    printf("\n----------------- Testing CAllocator hooks ------------------ \n");
+    allocCounts counts = {0, 0};
+    CAllocator counter = {counted_alloc, counted_realloc, counted_free, &counts};
+    CVector *cv = cvec_create_ex(&counter, sizeof(int), 0, NULL);
+    verify_int(1, counts.nblocks, "Blocks for a new CVector");
+    for (int i = 0; i < size; i++)
+        cvec_append(cv, &i);
+    cvec_remove_range(cv, 10, size - 10);
+    cvec_shrink_to_fit(cv);
+    verify_int(9, *(int *)cvec_nth(cv, 9), "*cvec_nth(9) after growing and shrinking");
+    cvec_dispose(cv);
+    verify_int(0, counts.nblocks, "Blocks outstanding after cvec_dispose");
+    verify_int(0, (int)counts.nbytes, "Bytes outstanding after cvec_dispose");
+
+    CMap *cm = cmap_create_ex(&counter, sizeof(int), 10, count_cleanup);
+    char key[16];
+    for (int i = 0; i < size; i++) {
+        sprintf(key, "key%d", i);
+        cmap_put(cm, key, &i);
+    }
+    verify_int(size + 2, counts.nblocks, "Blocks for CMap, buckets and cells");
+    ncleaned = 0;
+    cmap_dispose(cm);
+    verify_int(size, ncleaned, "Values cleaned by cmap_dispose");
+    verify_int(0, counts.nblocks, "Blocks outstanding after cmap_dispose");
+    verify_int(0, (int)counts.nbytes, "Bytes outstanding after cmap_dispose");
+}
+
+// must match the size of the inline buffer in cvector.c
+#ifndef CVEC_INLINE_BYTES
+#define CVEC_INLINE_BYTES 64
+#endif
+
+/* Function: inline_test
+ * ----------------------
+ * Watches element storage through a counting CAllocator: a CVector of small
+ * elements starts in its inline buffer (one block, for the struct), spills
+ * to a heap block with its contents intact once it outgrows it, and moves
+ * back when shrunk to fit. Elements too large for the buffer always get
+ * heap storage, and cleanup runs on elements held inline.
+ */
+static void inline_test(void)
+{
+    printf("\n----------------- Testing inline CVector storage ------------------ \n");
+    allocCounts counts = {0, 0};
+    CAllocator counter = {counted_alloc, counted_realloc, counted_free, &counts};
+    CVector *cv = cvec_create_ex(&counter, sizeof(int), 0, NULL);
+    int ninline = CVEC_INLINE_BYTES / sizeof(int);
+    for (int i = 0; i < ninline; i++)
+        cvec_append(cv, &i);
+    verify_int(1, counts.nblocks, "Blocks with inline buffer full");
+    cvec_append(cv, &ninline);
+    verify_int(2, counts.nblocks, "Blocks after spilling past inline buffer");
+    int bad = -1;
+    for (int i = 0; i <= ninline && bad == -1; i++)
+        if (*(int *)cvec_nth(cv, i) != i) bad = i;
+    verify_int(-1, bad, "First wrong element after spill");
+    cvec_remove_range(cv, 2, cvec_count(cv) - 2);
+    cvec_shrink_to_fit(cv);
+    verify_int(1, counts.nblocks, "Blocks after shrinking back inline");
+    verify_int(1, *(int *)cvec_nth(cv, 1), "*cvec_nth(1) after shrinking back inline");
+    cvec_dispose(cv);
+    verify_int(0, counts.nblocks, "Blocks outstanding after cvec_dispose");
+
+    char big[CVEC_INLINE_BYTES + 36];
+    cv = cvec_create_ex(&counter, sizeof(big), 1, NULL);
+    verify_int(2, counts.nblocks, "Blocks for CVector of elements larger than inline buffer");
+    memset(big, 'x', sizeof(big));
+    cvec_append(cv, big);
+    verify_int(0, memcmp(big, cvec_nth(cv, 0), sizeof(big)), "memcmp of large element");
+    cvec_dispose(cv);
+    verify_int(0, counts.nblocks, "Blocks outstanding after cvec_dispose");
+
+    cv = cvec_create_ex(&counter, sizeof(int), 0, count_cleanup);
+    for (int i = 0; i < 3; i++)
+        cvec_append(cv, &i);
+    verify_int(1, counts.nblocks, "Blocks for inline CVector with cleanup");
+    ncleaned = 0;
+    cvec_dispose(cv);
+    verify_int(3, ncleaned, "Inline elements cleaned by cvec_dispose");
+}
+
+/* Function: arena_test
+* ---------------------
+* Builds several CVectors inside one CArena, growing them past their
+* inline and hinted capacities, then checks contents survived growth and
+* that disposing the arena cleans up every element exactly once.
+*/
+static void arena_test(int nvecs, int nelems)
+{
+    printf("\n----------------- Testing arena CVectors ------------------ \n");
+    CArena *arena = carena_create(1024); // small chunks to force new chunks
+    CVector *vecs[nvecs];
+    for (int i = 0; i < nvecs; i++)
+        vecs[i] = cvec_create_in(arena, sizeof(int), 2, count_cleanup);
+    for (int j = 0; j < nelems; j++)
+        for (int i = 0; i < nvecs; i++) {
+            int val = i * nelems + j;
+            cvec_append(vecs[i], &val);
+        }
+    int bad = -1;
+    for (int i = 0; i < nvecs && bad == -1; i++)
+        for (int j = 0; j < nelems; j++)
+            if (*(int *)cvec_nth(vecs[i], j) != i * nelems + j) bad = i;
+    verify_int(-1, bad, "First arena CVector with wrong contents");
+    cvec_dispose(vecs[0]);
+    verify_int(nelems, ncleaned, "Elements cleaned by cvec_dispose");
+    carena_dispose(arena);
+    verify_int(nvecs * nelems, ncleaned, "Elements cleaned by carena_dispose");
+}
+
+
 int main(int argc, char *argv[])
 {
     simple_cvec();
     sortsearch_test();
     large_test(25000);
+    radix_test(100000);
+    arena_test(10, 1000);
+    range_test();
+    mapped_test(100000);
+    capacity_test(1000000);
+    segvec_test(10000);
+    template_test(10000);
+    deque_test(1000);
+    heap_test(10000, 100);
+    strvec_test(10000);
+    index_test(10000);
+    index_test(1);
+    set_test(100000);
+    concvec_test(100000);
+    serialize_test(100000);
+    stats_test();
+    allocator_test(10000);
+    inline_test();
     return 0;
 }
@@ -3,13 +3,36 @@
  * Author: Tiantian Tang 
  * -----------------------------------------------------------------------------
  * A heap allocator that implmenets mymalloc, myfree and myrealloc. Implemented
- * based on segregated explicit free lists. 
+ * based on segregated explicit free lists, indexed two-level segregated fit
+ * (TLSF) style: a first-level bitmap of non-empty size classes and, per
+ * class, a second-level bitmap of non-empty subclasses, so a suitable free
+ * list is found with two bit scans instead of a walk over lists and nodes.
+ *
+ * Requests of up to 256 bytes are served from slabs instead, once their
+ * size class has enough live blocks to fill four slabs: page-aligned heap
+ * blocks carved into objects of a single size class, with no header per
+ * object. A slab's metadata sits at the start of its page, so it is found
+ * from an object's address by masking. Requests of MMAP_THRESHOLD
+ * bytes or more bypass the heap segment: each gets a region mapped for it
+ * alone, unmapped when it is freed and resized with mremap. Freed heap
+ * blocks of up to 1 KB are kept on quick lists of one exact size each and
+ * reused as they are; they are coalesced in bulk only when the lists grow
+ * too big or nothing on the freelists fits.
+ *
+ * The allocator is thread-safe. The heap and slabs are shared and
+ * protected by one lock. In front of them each thread keeps a cache of
+ * small free objects (tcache), one singly-linked bin per slab class, so
+ * most small requests are served and freed without taking the lock. An
+ * empty bin is refilled with a batch of objects under one lock, and a full
+ * bin flushes a batch back to the slabs.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include "allocator.h"
 #include "segment.h"
 #pragma pack(1)
@@ -17,31 +40,46 @@
 /*Struct definitions*/
 /*----------------------------------------------------------------------------*/
 
-// prologue is a 16 bytes allocated block consists of only header and footer
-// created during init and never freed.
+// prologue is a 4 byte allocated header at the start of the heap, created
+// during init and never freed. It puts the first block's header 4 bytes
+// before an 8-byte boundary, and no free block at offset 0.
 typedef struct{
-    size_t header;
-    size_t footer;
+    uint32_t header;
 }prologue;
 
-// eiplogue is a 8 byte allocated block consists of only header.
+// eiplogue is a 4 byte allocated block consists of only header.
 typedef struct{
-    size_t header;
+    uint32_t header;
 }epilogue;
 
-// allocated block struct
+// allocated block struct, a header followed by the payload
 typedef struct allocatedBlock allocatedBlock;
 struct  allocatedBlock{
-    size_t header;
+    uint32_t header;
 };
 
-// freed block struct
+// freed block struct, ends with a footer that copies the header. Links
+// are offsets of the neighboring free blocks from heap_start, 0 for none
 typedef struct freeBlock freeBlock;
 
 struct freeBlock {
-    size_t header; // header size:
-    freeBlock *prev; // pree fereed block pointer
-    freeBlock *next; // next freed block pointer
+    uint32_t header; // header size:
+    uint32_t prev; // pree fereed block offset
+    uint32_t next; // next freed block offset
+};
+
+
+// slab header, at the start of the slab's page
+typedef struct slab slab;
+struct slab {
+    void *free; // freed objects, chained through their first word
+    char *unused; // objects from here to the end were never handed out
+    slab *prev; // neighbors on the partial list of its class
+    slab *next;
+    int cls; // size class
+    unsigned objsz; // object size in bytes
+    unsigned nobjs; // objects that fit in the slab
+    unsigned nfree; // objects not handed out, on free or still unused
 };
 
 
@@ -50,51 +88,176 @@ struct freeBlock {
 
 // Heap blocks are required to be aligned to 8-byte boundary
 #define ALIGNMENT 8
-#define NUM_BUCKETS 29 
 #define MIN(x,y) ((x) < (y) ? (x) : (y))
-#define MINBLKSZ 40
-// Pack a size and allocated bit into header/footer.
-// alloc bit is LSB, rest indicate size in bytes
-#define PACK(size, alloc) ((size) | (alloc))
+// Size of a header or footer. Block sizes are multiples of 8 and headers
+// sit 4 bytes before an 8-byte boundary, so every payload is aligned
+#define WSIZE sizeof(uint32_t)
+// Smallest block: header, two links and footer once it is freed
+#define MINBLKSZ (sizeof(freeBlock) + WSIZE)
+// Sizes and offsets are 32 bits, so the heap uses at most the first 4 GB
+// of its segment
+#define MAX_HEAP_SIZE ((size_t)1 << 32)
+
+// Pack a block size and status bits into header/footer.
+// alloc bit is LSB, bits from 3 up are the size of the whole block in bytes
+#define PACK(size, alloc) ((uint32_t)((size) | (alloc)))
+#define ALLOC 0x1
+
+// Bit set in a block's header when the block to its left is allocated.
+// Allocated blocks have no footer, so a block may only look at its left
+// neighbor's footer when this bit is clear
+#define PREV_ALLOC 0x2
+
+// Bit set in the header/footer of a free block whose interior pages have
+// all been given back to the OS
+#define RELEASED 0x4
+
+// Bit set in the header of a block in a region mapped for it alone. Its
+// size is the size of the whole region. Only allocated blocks are mapped,
+// so it shares a bit with RELEASED
+#define MAPPED 0x4
 
 // Read and write at header/footer pointed by p
-#define GET(p) (*(size_t *) (p))
-#define PUT(p, val) (*(size_t *) (p) = (val))
+#define GET(p) (*(uint32_t *) (p))
+#define PUT(p, val) (*(uint32_t *) (p) = (val))
 
 // Return pointer to payload section for an allocated block
-#define GET_PAYLOAD_PTR(blkptr) ((char *)blkptr + sizeof(size_t))
+#define GET_PAYLOAD_PTR(blkptr) ((char *)blkptr + WSIZE)
 
 // Return pointer to header for a block given pointer to payload
-#define GET_HEADER(ptr) ((char *) ptr - sizeof(size_t));
+#define GET_HEADER(ptr) ((char *) ptr - WSIZE)
 
 //Return size of block giving pointer to header/footer
 #define GET_SIZE(ptr) (GET(ptr) & ~0x7)
 
 //Return allocation bit given pointer to header/footer
-#define GET_ALLOC(ptr) (GET(ptr) & 0x1)
+#define GET_ALLOC(ptr) (GET(ptr) & ALLOC)
+
+//Return whether the left neighbor is allocated given pointer to header
+#define GET_PREV_ALLOC(ptr) (GET(ptr) & PREV_ALLOC)
 
-// Compute address of footer, given pointer to a block
-#define FTRP(headerptr) ((char *)headerptr + sizeof(size_t) + GET_SIZE(headerptr))
+// Compute address of footer, given pointer to a free block
+#define FTRP(headerptr) ((char *)headerptr + GET_SIZE(headerptr) - WSIZE)
 
-//Return address for left block,  given ptr to a  block's header
-#define LEFT_BLK(headerptr) ( (char*)headerptr - sizeof(size_t) * 2 - GET_SIZE((char*)headerptr - sizeof(size_t)))
+//Return address for left block,  given ptr to a  block's header. Only
+//valid when the left block is free
+#define LEFT_BLK(headerptr) ( (char*)headerptr - GET_SIZE((char*)headerptr - WSIZE))
 
 //Return address for right  block  given ptr to a block's header
-#define RIGHT_BLK(headerptr) ((char*) headerptr + sizeof(size_t) * 2 + GET_SIZE(headerptr))
+#define RIGHT_BLK(headerptr) ((char*) headerptr + GET_SIZE(headerptr))
 
 #define REALLOC_FACTOR 1.5 //
 
+// TLSF size classes. Sizes below SMALL_SIZE go in NUM_SL lists 8 bytes
+// apart (first-level class 0). Above that, first-level class fl holds sizes
+// [2^(fl+FL_SHIFT-1), 2^(fl+FL_SHIFT)), split into NUM_SL equal subclasses
+#define SL_LOG2 4
+#define NUM_SL (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 3)
+#define SMALL_SIZE (1 << FL_SHIFT)
+#define NUM_FL 26 // blocks up to MAX_HEAP_SIZE
+
+// Slabs serve requests up to SLAB_MAX_SIZE in NUM_SLAB_CLASSES object
+// sizes: multiples of 8 up to 64, of 16 up to 128, of 32 up to 256. A slab
+// is a heap block of one page whose SLAB_PAYLOAD bytes start on a page
+// boundary, so its header takes the last 4 bytes of the previous page, and
+// slabs carved from one free block pack end to end
+#define SLAB_MAX_SIZE 256
+#define NUM_SLAB_CLASSES 16
+#define SLAB_PAYLOAD (PAGE_SIZE - WSIZE)
+#define SLAB_OF(ptr) ((slab *)((uintptr_t)(ptr) & ~(uintptr_t)(PAGE_SIZE - 1)))
+
+// A class gets its first slab only once its live heap blocks would fill
+// SLAB_MIN_LIVE bytes of objects, four slabs' worth. Until then its
+// requests are served from the heap like larger ones, so slabs are only
+// used where they stay dense and what a class leaves parked in its partly
+// used slabs and the thread caches is small beside what it holds
+#define SLAB_MIN_LIVE (PAGE_SIZE * 4)
+
+// Defaults for the mymallopt parameters. The free block at the end of the
+// heap is trimmed once it reaches TRIM_THRESHOLD bytes, down to TOP_PAD
+// bytes so the next growth need not extend the heap again. Pages inside
+// other free blocks of RELEASE_THRESHOLD bytes or more are given back
+#define DEFAULT_TRIM_THRESHOLD (1 << 20)
+#define DEFAULT_TOP_PAD (256 << 10)
+#define DEFAULT_RELEASE_THRESHOLD (1 << 20)
+
+// Default for the smallest request given a mapped region of its own
+#define DEFAULT_MMAP_THRESHOLD (256 << 10)
+
+// A freed heap block of up to QUICK_MAX_SIZE bytes with no free neighbor
+// goes on the quick list for its exact size, without coalescing, and stays
+// marked allocated so its neighbors do not merge with it either. The quick
+// lists are consolidated into the freelists once they hold more than
+// QUICK_MAX_BYTES, or when no free block fits a request
+#define QUICK_MAX_SIZE 1024
+#define QUICK_MAX_BYTES (64 << 10)
+
+// A tcache bin holds at most TCACHE_COUNT objects and TCACHE_BYTES bytes
+// of them, but never less than a batch, and is refilled or flushed
+// TCACHE_BATCH objects at a time
+#define TCACHE_COUNT 8
+#define TCACHE_BYTES 1024
+#define TCACHE_BATCH 4
+
 /*------------------------------------------------------------------*/
 
 // Function declaration
 freeBlock * coalesce(freeBlock * blkptr);
+bool consolidate(void);
 
 /*Global varibles*/
 /*------------------------------------------------------------------*/
 void *heap_listp; // points to start of most recent allocated page
 size_t pagecnt; // record how many pages are currently allocated
 int validatecnt;// how many times validat_heap() is called
-freeBlock *freelist_arr[NUM_BUCKETS];
+freeBlock *freelist_arr[NUM_FL][NUM_SL];
+unsigned fl_bitmap; // bit fl set if any freelist_arr[fl][*] is non-empty
+unsigned sl_bitmap[NUM_FL]; // bit sl of entry fl set if freelist_arr[fl][sl] is non-empty
+freeBlock *quick_lists[QUICK_MAX_SIZE / ALIGNMENT + 1]; // freed blocks of each size, chained through next
+size_t quick_bytes; // bytes in blocks on quick_lists
+
+char *heap_start; // base of the heap segment
+slab *partial_slabs[NUM_SLAB_CLASSES]; // slabs of each class with a free object
+bool slab_page[MAX_HEAP_SIZE / PAGE_SIZE]; // which heap pages are slabs
+bool slab_ready[NUM_SLAB_CLASSES]; // class is served from slabs
+unsigned slab_live[NUM_SLAB_CLASSES]; // heap blocks of each class not yet ready
+
+// object size of each slab class, and class serving each size rounded up to 8
+static const unsigned short slab_objsz[NUM_SLAB_CLASSES] = {
+    8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256
+};
+static const unsigned char slab_class[SLAB_MAX_SIZE / ALIGNMENT + 1] = {
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+    12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15
+};
+
+// parameters set with mymallopt. They are read without heap_lock, so they
+// are only loaded and stored with relaxed atomics
+size_t trim_threshold = DEFAULT_TRIM_THRESHOLD;
+size_t top_pad = DEFAULT_TOP_PAD;
+size_t release_threshold = DEFAULT_RELEASE_THRESHOLD;
+size_t mmap_threshold = DEFAULT_MMAP_THRESHOLD;
+
+// heap_lock protects everything above but the mymallopt parameters.
+// heap_generation counts myinit
+// calls, so a thread cache holding objects of a discarded heap can tell
+pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned long heap_generation;
+
+// A thread's cache of free slab objects. Objects in it still count as
+// handed out by their slab; bin[cls] chains objects of slab class cls
+// through their first word
+typedef struct {
+    void *bin[NUM_SLAB_CLASSES];
+    int count[NUM_SLAB_CLASSES];
+    unsigned long generation; // heap_generation the blocks belong to
+    bool registered; // tcache_key destructor set for this thread
+} tcache_t;
+
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
 
 /*Inline functions*/
 /*------------------------------------------------------------------*/
@@ -105,47 +268,93 @@ static inline size_t roundup(size_t sz, size_t mult)
     return (sz + mult-1) & ~(mult-1);
 }
 
-// Calculate log_2(num)
-static inline size_t log_2(size_t num){
-    size_t res = 0;
-    while (num > 0){
-        num >>= 1;
-        res++;
+// Index of the most significant set bit of num, which must be non-zero
+static inline int msb(size_t num){
+    return 63 - __builtin_clzl(num);
+}
+
+// Size class of the free list a block of blksz belongs on
+static inline void mapping_insert(size_t blksz, int *pfl, int *psl){
+    if (blksz < SMALL_SIZE){
+        *pfl = 0;
+        *psl = blksz / (SMALL_SIZE / NUM_SL);
+    }else{
+        int top = msb(blksz);
+        *pfl = top - FL_SHIFT + 1;
+        *psl = (blksz >> (top - SL_LOG2)) ^ NUM_SL;
     }
-    return res;
 }
 
-// Set a block header and footer with payloadsz and allocation
-static inline void set_block(void *blkptr, size_t payloadsz, size_t alloc){
-    size_t headerval =  PACK(payloadsz, alloc);
+// Size class to start searching from for a request of asize. The size is
+// rounded up to the next subclass boundary so that every block in that
+// class or above is big enough, and no list needs to be walked
+static inline void mapping_search(size_t asize, int *pfl, int *psl){
+    if (asize >= SMALL_SIZE) asize += ((size_t)1 << (msb(asize) - SL_LOG2)) - 1;
+    mapping_insert(asize, pfl, psl);
+}
+
+// Set a block header with blksz and the status bits, and its footer too
+// if the block is free
+static inline void set_block(void *blkptr, size_t blksz, size_t bits){
+    uint32_t headerval =  PACK(blksz, bits);
     PUT(blkptr, headerval);
-    PUT(FTRP(blkptr), headerval);
+    if (!(bits & ALLOC)) PUT(FTRP(blkptr), headerval);
+}
+
+// Record in a block's header whether the block to its left is allocated.
+// The header may be of an allocated block whose size its owner reads
+// without the lock, so the store is atomic; the size bits do not change
+static inline void set_prev_alloc(void *blkptr, bool alloc){
+    uint32_t headerval = alloc ? GET(blkptr) | PREV_ALLOC : GET(blkptr) & ~PREV_ALLOC;
+    __atomic_store_n((uint32_t *)blkptr, headerval, __ATOMIC_RELAXED);
+    if (!GET_ALLOC(blkptr)) PUT(FTRP(blkptr), headerval);
+}
+
+// Mark a block allocated with blksz, and tell the block to its right
+static inline void set_allocated(void *blkptr, size_t blksz){
+    set_block(blkptr, blksz, ALLOC | GET_PREV_ALLOC(blkptr));
+    set_prev_alloc(RIGHT_BLK(blkptr), true);
+}
+
+// Free block at an offset from heap_start, and back
+static inline freeBlock *blk_at(uint32_t offset){
+    return offset == 0 ? NULL : (freeBlock *)(heap_start + offset);
+}
+
+static inline uint32_t blk_offset(freeBlock *blkptr){
+    return blkptr == NULL ? 0 : (uint32_t)((char *)blkptr - heap_start);
+}
+
+// Size of the heap block serving a request of requestedsz
+static inline size_t block_size(size_t requestedsz){
+    size_t asize = roundup(requestedsz + WSIZE, ALIGNMENT);
+    return asize < MINBLKSZ ? MINBLKSZ : asize;
 }
 
 /*
  * Function: insert_node
  * -----------------------------------------------------------------------------
- * Given pointer to a freed block. Find correct size freelist to insert to
- * then insert to beginning. 
- *
- * bucket idx == 0, contain free block size up to 8
- * bucket idx == 1, contain free block (8, 16]
- * bucket idx == 2, contains free block size up to(16, 32]
- *
- * payload range each idx correspond to is (8*2^(idx - 1), 8*2^idx]
+ * Given pointer to a freed block. Coalesce it with free neighbors, then
+ * insert the result at the beginning of the freelist for its size class
+ * and mark that list non-empty in the bitmaps. The block to its right is
+ * told it now has a free left neighbor.
  *
+ * Return the pointer to the inserted (possibly coalesced) block
  * */
-void insert_node(freeBlock *blkptr){
-    size_t bucketidx = MIN((log_2(GET_SIZE(blkptr)/ALIGNMENT)), NUM_BUCKETS - 1);
-    freeBlock *head = freelist_arr[bucketidx];
-
-    blkptr->prev = NULL;
-    blkptr->next = head;
-    if (head != NULL) head->prev = blkptr;
-    freelist_arr[bucketidx] = blkptr;
-
-    // coalsece newlly inserted node
-    coalesce(blkptr);
+freeBlock *insert_node(freeBlock *blkptr){
+    int fl, sl;
+    blkptr = coalesce(blkptr);
+    set_prev_alloc(RIGHT_BLK(blkptr), false);
+    mapping_insert(GET_SIZE(blkptr), &fl, &sl);
+    freeBlock *head = freelist_arr[fl][sl];
+
+    blkptr->prev = 0;
+    blkptr->next = blk_offset(head);
+    if (head != NULL) head->prev = blk_offset(blkptr);
+    freelist_arr[fl][sl] = blkptr;
+    fl_bitmap |= 1U << fl;
+    sl_bitmap[fl] |= 1U << sl;
+    return blkptr;
 }
 
 /* Function: add_page
@@ -153,50 +362,52 @@ void insert_node(freeBlock *blkptr){
  * Request page from OS for requested asize. Set up or update prologue and 
  * epilogue for the heap. Requested page will be setup as a giant free block
  * If request page is not initial page, will call coalesce to prime heap.
+ *
+ * Return the free block holding the new pages, NULL if the heap is full
+ * or cannot grow enough to hold asize
  */
-bool add_page(size_t asize){
+freeBlock *add_page(size_t asize){
     freeBlock * bigpageblk;
     size_t numofpage = pagecnt/10;// Request some extra pages to reduce time
-    size_t payloadsz;
+    size_t blksz;
 
     if (pagecnt == 0){ // initial page request
-        numofpage  += (asize/(PAGE_SIZE - sizeof(prologue) - sizeof(epilogue) - MINBLKSZ)) + 1; 
+        numofpage  += (asize/(PAGE_SIZE - sizeof(prologue) - sizeof(epilogue) - MINBLKSZ)) + 1;
         // denominator of first operatnd is the effective area for allocation when add page for the first time
     }else{
-        numofpage  += (asize/(PAGE_SIZE -  MINBLKSZ)) + 1; 
+        numofpage  += (asize/(PAGE_SIZE -  MINBLKSZ)) + 1;
         // denominator of first operatnd is the effective area for allocation  when adding addtioanl page
     }
+    if (numofpage > MAX_HEAP_SIZE / PAGE_SIZE - pagecnt) numofpage = MAX_HEAP_SIZE / PAGE_SIZE - pagecnt;
+    if (numofpage == 0) return NULL;
 
     heap_listp = extend_heap_segment(numofpage);
-    if (heap_listp == NULL) return false;  
+    if (heap_listp == NULL) return NULL;
 
-    // Update epilogue
+    // Update epilogue, whose left neighbor is the new free block
     epilogue *epi = (epilogue *) ((char *)heap_listp + numofpage * PAGE_SIZE - sizeof(epilogue));
-    epi->header = PACK(0, 1); 
+    epi->header = PACK(0, ALLOC);
 
     if (pagecnt == 0){//initial page request
-        //set up prologue 
+        //set up prologue
         prologue *pro = heap_listp;
-        pro->header = PACK(0, 1);
-        pro->footer = PACK(0, 1);
+        pro->header = PACK(0, ALLOC);
 
         //newly allocated page is a giant freeBlock. set it and add to freelistp
         bigpageblk = (freeBlock *) ((char *)heap_listp + sizeof(prologue));
-        payloadsz = numofpage * PAGE_SIZE - sizeof(prologue) - sizeof(epilogue) - sizeof(size_t) * 2;
+        blksz = numofpage * PAGE_SIZE - sizeof(prologue) - sizeof(epilogue);
 
-
-        set_block(bigpageblk, payloadsz, 0);
-        insert_node(bigpageblk);
+        set_block(bigpageblk, blksz, PREV_ALLOC);
     }else{
         bigpageblk = (freeBlock *) ((char *)heap_listp - sizeof(epilogue)); // freedblock starts at epilogue of previous add_page
-        payloadsz =  (char *) epi - (char*) bigpageblk - sizeof(size_t) * 2;
+        blksz =  numofpage * PAGE_SIZE;
 
-        set_block(bigpageblk, payloadsz, 0);
-        insert_node(bigpageblk);
+        set_block(bigpageblk, blksz, GET_PREV_ALLOC(bigpageblk));
     }
 
     pagecnt += numofpage;
-    return true;
+    bigpageblk = insert_node(bigpageblk);
+    return GET_SIZE(bigpageblk) >= asize ? bigpageblk : NULL;
 }
 
 /* Function:myinit 
@@ -210,21 +421,35 @@ bool add_page(size_t asize){
  * requests are made. It may also be called later to wipe out the current
  * heap contents and start over fresh. This "reset" option is specifically
  * needed by the test harness to run a sequence of scripts, one after another,
- * without restarting program from scratch.
+ * without restarting program from scratch. No other thread may be using the
+ * heap while it is reset; blocks in any thread's cache are discarded with it.
  */
 bool myinit()
 {
+    pthread_mutex_lock(&heap_lock);
+    __atomic_add_fetch(&heap_generation, 1, __ATOMIC_RELAXED);
+    if (heap_start != NULL) memset(slab_page, 0, pagecnt * sizeof(slab_page[0]));
+    memset(partial_slabs, 0, sizeof(partial_slabs));
+    memset(slab_ready, 0, sizeof(slab_ready));
+    memset(slab_live, 0, sizeof(slab_live));
     heap_listp= init_heap_segment(0); 
-    if (heap_listp == NULL) return false; // allocation failure 
+    heap_start = heap_listp;
+    if (heap_listp == NULL){
+        pthread_mutex_unlock(&heap_lock);
+        return false; // allocation failure 
+    }
 
     //Initialize global variables
     pagecnt = 0;
     validatecnt = 0;
 
     //initialize freelist_arr elements to NULL
-    for (int i = 0; i < NUM_BUCKETS; i++){
-        freelist_arr[i] = NULL; 
-    }
+    memset(freelist_arr, 0, sizeof(freelist_arr));
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(quick_lists, 0, sizeof(quick_lists));
+    quick_bytes = 0;
+    pthread_mutex_unlock(&heap_lock);
     return true;
 }
 
@@ -232,21 +457,24 @@ bool myinit()
 
 /* Function:find_fit 
  * -----------------------------------------------------------------------------
- * First fit to find free block with size >= asize. Search in corresponding free
- * list. If not, search innext larger free list.
+ * Good fit in constant time: find the first non-empty freelist at or above
+ * the rounded-up size class of asize, using the second-level bitmap of
+ * that class and, failing that, the first-level bitmap. Any block on that
+ * list is big enough, so its head is taken.
  */
 freeBlock *find_fit(size_t asize){
-    int bucketidx = MIN((log_2(asize/ALIGNMENT)), NUM_BUCKETS - 1);
-    freeBlock *blkptr; 
-
-    for (size_t i = bucketidx; i < NUM_BUCKETS;i++){
-        for (blkptr = freelist_arr[i]; blkptr != NULL; blkptr  = blkptr->next){
-            if(asize <=  GET_SIZE(blkptr)){
-                return blkptr;       
-            }
-        }
+    int fl, sl;
+    mapping_search(asize, &fl, &sl);
+    if (fl >= NUM_FL) return NULL;
+
+    unsigned slmap = sl_bitmap[fl] & (~0U << sl);
+    if (slmap == 0){ // nothing in this class, go to the next non-empty one
+        unsigned flmap = fl_bitmap & (~0U << (fl + 1));
+        if (flmap == 0) return NULL;
+        fl = __builtin_ctz(flmap);
+        slmap = sl_bitmap[fl];
     }
-    return NULL;
+    return freelist_arr[fl][__builtin_ctz(slmap)];
 }
 
 
@@ -256,17 +484,24 @@ freeBlock *find_fit(size_t asize){
  */
 void delete_node(freeBlock *ptr){
     if (ptr == NULL) return;
-    size_t bucketidx = MIN(log_2(GET_SIZE(ptr)/ALIGNMENT), NUM_BUCKETS - 1);
+    int fl, sl;
+    mapping_insert(GET_SIZE(ptr), &fl, &sl);
 
-    if (ptr->prev == NULL){ // case1: node is at beginning
-        freelist_arr[bucketidx]= ptr->next; // update head
-        if (freelist_arr[bucketidx]!= NULL) freelist_arr[bucketidx]->prev = NULL; 
+    freeBlock *prev = blk_at(ptr->prev), *next = blk_at(ptr->next);
+
+    if (prev == NULL){ // case1: node is at beginning
+        freelist_arr[fl][sl]= next; // update head
+        if (next != NULL) next->prev = 0;
         // initialize head's prev to null
-    }else if (ptr->next == NULL){//case 2 node is at the end
-        ptr->prev->next = NULL;
+        else{ // list now empty, clear its bits
+            sl_bitmap[fl] &= ~(1U << sl);
+            if (sl_bitmap[fl] == 0) fl_bitmap &= ~(1U << fl);
+        }
+    }else if (next == NULL){//case 2 node is at the end
+        prev->next = 0;
     }else{//case3: node is in the middle
-        ptr->prev->next = ptr->next;
-        ptr->next->prev = ptr->prev;
+        prev->next = ptr->next;
+        next->prev = ptr->prev;
 
     }
 }
@@ -279,28 +514,419 @@ void delete_node(freeBlock *ptr){
  */
 void place(freeBlock *blkptr, size_t asize){
     size_t csize = GET_SIZE(blkptr);
+    size_t released = GET(blkptr) & RELEASED;
 
-    if (csize - asize < MINBLKSZ){  
-        set_block(blkptr, csize, 1);
+    if (csize - asize < MINBLKSZ){
         delete_node(blkptr);
-    }else{ // if available free blk is big enough to be splitted 
+        set_allocated(blkptr, csize);
+    }else{ // if available free blk is big enough to be splitted
         delete_node(blkptr);
 
         //allocate with asize
-        set_block(blkptr, asize, 1);
+        set_block(blkptr, asize, ALLOC | GET_PREV_ALLOC(blkptr));
 
-        // Find starting address for remaining block and payload
-        freeBlock *restblk = (freeBlock *) ((char*) blkptr + sizeof(size_t) * 2 + asize);
-        size_t restsz = csize - asize - 2 * sizeof(size_t);
-        set_block(restblk, restsz, 0);
+        // Find starting address for remaining block. Its pages are a
+        // subset of blkptr's, so it stays released if blkptr was
+        freeBlock *restblk = (freeBlock *) RIGHT_BLK(blkptr);
+        set_block(restblk, csize - asize, PREV_ALLOC | released);
         insert_node(restblk);
     }
 }
 
 
+/* Function: heap_alloc
+ * -----------------------------------------------------------------------------
+ * Allocate a block of size asize from the shared heap. A block of exactly
+ * that size on a quick list is reused as it is. Otherwise a free block is
+ * split, after consolidating the quick lists if none fits. Caller must
+ * hold heap_lock.
+ *
+ * Return pointer to the block, NULL if the heap is full
+ */
+freeBlock *heap_alloc(size_t asize){
+    freeBlock *blkptr;
+    if (asize <= QUICK_MAX_SIZE && (blkptr = quick_lists[asize / ALIGNMENT]) != NULL){
+        quick_lists[asize / ALIGNMENT] = blk_at(blkptr->next);
+        quick_bytes -= asize;
+        return blkptr; // never marked free
+    }
+
+    blkptr = find_fit(asize);
+    if (blkptr == NULL && consolidate()) blkptr = find_fit(asize);
+    if (blkptr == NULL && (blkptr = add_page(asize)) == NULL) return NULL;
+    place(blkptr, asize);
+    return blkptr;
+}
+
+
+/* Function: trim_heap
+ * -----------------------------------------------------------------------------
+ * Given the free block last before the epilogue, shrink the heap segment
+ * to leave it top_pad bytes, moving the epilogue down.
+ */
+void trim_heap(freeBlock *blkptr){
+    size_t blksz = GET_SIZE(blkptr);
+    size_t keep = __atomic_load_n(&top_pad, __ATOMIC_RELAXED);
+    if (keep < MINBLKSZ) keep = MINBLKSZ;
+    if (blksz <= keep) return;
+    size_t numofpage = (blksz - keep) / PAGE_SIZE;
+    if (numofpage == 0) return;
+
+    void *end = shrink_heap_segment(numofpage);
+    if (end == NULL) return;
+    delete_node(blkptr);
+    set_block(blkptr, blksz - numofpage * PAGE_SIZE, GET_PREV_ALLOC(blkptr));
+    ((epilogue *)((char *)end - sizeof(epilogue)))->header = PACK(0, ALLOC);
+    pagecnt -= numofpage;
+    insert_node(blkptr);
+}
+
+
+/* Function: release_block
+ * -----------------------------------------------------------------------------
+ * Given a free block just made by freeing memory and coalescing, where
+ * [start, end) covers every part of it that may still have resident
+ * pages. Trim the heap if the block is last and big enough, otherwise give
+ * back the whole pages of that part if the block is big enough, keeping
+ * the block's header, list pointers and footer, and mark it released.
+ */
+void release_block(freeBlock *blkptr, char *start, char *end){
+    size_t blksz = GET_SIZE(blkptr);
+    if (GET_SIZE(RIGHT_BLK(blkptr)) == 0 && blksz >= __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED)){ // epilogue
+        trim_heap(blkptr);
+        return;
+    }
+    if (blksz < __atomic_load_n(&release_threshold, __ATOMIC_RELAXED)) return;
+
+    uintptr_t lo = (uintptr_t)(start > (char *)(blkptr + 1) ? start : (char *)(blkptr + 1));
+    uintptr_t hi = (uintptr_t)(end < FTRP(blkptr) ? end : FTRP(blkptr));
+    lo = roundup(lo, PAGE_SIZE);
+    hi &= ~(uintptr_t)(PAGE_SIZE - 1);
+    if (hi > lo && !release_heap_pages((void *)lo, (hi - lo) / PAGE_SIZE)) return;
+    set_block(blkptr, blksz, RELEASED | GET_PREV_ALLOC(blkptr));
+}
+
+
+/* Function: heap_free
+ * -----------------------------------------------------------------------------
+ * Return an allocated block to the shared heap, then give memory back to
+ * the OS if it leaves a large enough free block. Caller must hold heap_lock.
+ */
+void heap_free(allocatedBlock *blkptr){
+    // the part of the coalesced block that may have resident pages: this
+    // block and any free neighbor not already released
+    char *start = (char *)blkptr, *end = RIGHT_BLK(blkptr);
+    if (!GET_PREV_ALLOC(blkptr) && !(GET(LEFT_BLK(blkptr)) & RELEASED)) start = LEFT_BLK(blkptr);
+    if (!GET_ALLOC(end) && !(GET(end) & RELEASED)) end = RIGHT_BLK(end);
+
+    set_block(blkptr, GET_SIZE(blkptr), GET_PREV_ALLOC(blkptr));
+    release_block(insert_node((freeBlock *)blkptr), start, end);
+}
+
+
+/* Function: quick_free
+ * -----------------------------------------------------------------------------
+ * Put a freed heap block on the quick list for its size, leaving it marked
+ * allocated, and consolidate the quick lists if they now hold too much.
+ * Caller must hold heap_lock.
+ */
+void quick_free(allocatedBlock *blkptr){
+    size_t blksz = GET_SIZE(blkptr);
+    ((freeBlock *)blkptr)->next = blk_offset(quick_lists[blksz / ALIGNMENT]);
+    quick_lists[blksz / ALIGNMENT] = (freeBlock *)blkptr;
+    quick_bytes += blksz;
+    if (quick_bytes > QUICK_MAX_BYTES) consolidate();
+}
+
+
+/* Function: consolidate
+ * -----------------------------------------------------------------------------
+ * Empty every quick list, freeing its blocks into the freelists with
+ * heap_free, which coalesces them with each other and their neighbors.
+ * Caller must hold heap_lock.
+ *
+ * Return whether any block was freed
+ */
+bool consolidate(void){
+    if (quick_bytes == 0) return false;
+    for (int i = 0; i <= QUICK_MAX_SIZE / ALIGNMENT; i++){
+        freeBlock *blkptr = quick_lists[i];
+        quick_lists[i] = NULL;
+        while (blkptr != NULL){
+            freeBlock *next = blk_at(blkptr->next);
+            heap_free((allocatedBlock *)blkptr);
+            blkptr = next;
+        }
+    }
+    quick_bytes = 0;
+    return true;
+}
+
+
+// Where a slab's payload would start in the free block at blkptr: the
+// first page boundary leaving no piece in front, or one big enough to be a
+// free block. NULL if the slab would not fit before the block ends
+static char *slab_place(freeBlock *blkptr){
+    char *payload = GET_PAYLOAD_PTR(blkptr);
+    char *aligned = (char *)roundup((uintptr_t)payload, PAGE_SIZE);
+    if (aligned != payload && aligned - payload < MINBLKSZ)
+        aligned += PAGE_SIZE; // leading piece too small to be a free block
+    return GET_HEADER(aligned) + PAGE_SIZE <= (char *)RIGHT_BLK(blkptr) ? aligned : NULL;
+}
+
+
+/* Function: find_slab_fit
+ * -----------------------------------------------------------------------------
+ * Find a free block a slab fits in. Any block of 2 * PAGE_SIZE + MINBLKSZ
+ * bytes does, and is found in constant time; failing that, the head of each
+ * non-empty list of smaller blocks from PAGE_SIZE up is tried in case it
+ * happens to be placed right, so a fragmented heap need not grow for a
+ * slab. Only heads are tried, so the work is bounded by the number of lists.
+ *
+ * Return pointer to the block, NULL if there is none
+ */
+static freeBlock *find_slab_fit(void){
+    freeBlock *blkptr = find_fit(PAGE_SIZE * 2 + MINBLKSZ);
+    if (blkptr != NULL) return blkptr;
+    int fl, sl;
+    mapping_insert(PAGE_SIZE, &fl, &sl);
+    for (; fl < NUM_FL; fl++, sl = 0){
+        for (unsigned slmap = sl_bitmap[fl] & (~0U << sl); slmap != 0; slmap &= slmap - 1){
+            blkptr = freelist_arr[fl][__builtin_ctz(slmap)];
+            if (slab_place(blkptr) != NULL) return blkptr;
+        }
+    }
+    return NULL;
+}
+
+
+/* Function: heap_alloc_slab
+ * -----------------------------------------------------------------------------
+ * Allocate a block with SLAB_PAYLOAD payload starting on a page boundary.
+ * Takes a free block with room to spare, and puts the pieces before and
+ * after the slab back on the freelists. Caller must hold heap_lock.
+ *
+ * Return pointer to the payload, NULL if the heap is full
+ */
+void *heap_alloc_slab(void){
+    size_t need = PAGE_SIZE * 2 + MINBLKSZ;
+    freeBlock *blkptr = find_slab_fit();
+    if (blkptr == NULL && consolidate()) blkptr = find_slab_fit();
+    if (blkptr == NULL && (blkptr = add_page(need)) == NULL) return NULL;
+    delete_node(blkptr);
+
+    char *payload = GET_PAYLOAD_PTR(blkptr);
+    char *end = RIGHT_BLK(blkptr); // end of the whole free block
+    char *aligned = slab_place(blkptr);
+
+    // slab first, so the pieces around it see an allocated neighbor
+    char *slabblk = GET_HEADER(aligned);
+    size_t prev_alloc = aligned == payload ? GET_PREV_ALLOC(blkptr) : 0;
+    size_t restsz = end - (slabblk + PAGE_SIZE);
+    if (restsz < MINBLKSZ){ // too small to split off
+        set_block(slabblk, end - slabblk, ALLOC | prev_alloc);
+        set_prev_alloc(end, true);
+    }else{
+        set_block(slabblk, PAGE_SIZE, ALLOC | prev_alloc);
+        freeBlock *restblk = (freeBlock *)(slabblk + PAGE_SIZE);
+        set_block(restblk, restsz, PREV_ALLOC);
+        insert_node(restblk);
+    }
+    if (aligned != payload){
+        set_block(blkptr, slabblk - (char *)blkptr, GET_PREV_ALLOC(blkptr));
+        insert_node(blkptr);
+    }
+    return aligned;
+}
+
+
+/* Function: slab_link / slab_unlink
+ * -----------------------------------------------------------------------------
+ * Add a slab to the head of, or remove it from, the partial list of its
+ * class.
+ */
+static void slab_link(slab *s){
+    s->prev = NULL;
+    s->next = partial_slabs[s->cls];
+    if (s->next != NULL) s->next->prev = s;
+    partial_slabs[s->cls] = s;
+}
+
+static void slab_unlink(slab *s){
+    if (s->prev != NULL) s->prev->next = s->next;
+    else partial_slabs[s->cls] = s->next;
+    if (s->next != NULL) s->next->prev = s->prev;
+}
+
+
+/* Function: slab_alloc
+ * -----------------------------------------------------------------------------
+ * Take an object of class cls from a partial slab, creating a slab if
+ * there is none. Caller must hold heap_lock.
+ *
+ * Return pointer to the object, NULL if the heap is full
+ */
+void *slab_alloc(int cls){
+    slab *s = partial_slabs[cls];
+    if (s == NULL){
+        if ((s = heap_alloc_slab()) == NULL) return NULL;
+        s->cls = cls;
+        s->objsz = slab_objsz[cls];
+        s->unused = (char *)s + roundup(sizeof(slab), ALIGNMENT);
+        s->nobjs = s->nfree = ((char *)s + SLAB_PAYLOAD - s->unused) / s->objsz;
+        s->free = NULL;
+        slab_page[((char *)s - heap_start) / PAGE_SIZE] = true;
+        slab_link(s);
+    }
+
+    void *obj;
+    if (s->free != NULL){
+        obj = s->free;
+        s->free = *(void **)obj;
+    }else{
+        obj = s->unused;
+        s->unused += s->objsz;
+    }
+    if (--s->nfree == 0) slab_unlink(s); // now full
+    return obj;
+}
+
+
+/* Function: slab_free
+ * -----------------------------------------------------------------------------
+ * Give an object back to its slab. A slab with every object free goes back
+ * to the heap at once; the thread caches in front of the slabs already
+ * absorb a class being emptied and refilled. Caller must hold heap_lock.
+ */
+void slab_free(void *obj){
+    slab *s = SLAB_OF(obj);
+    *(void **)obj = s->free;
+    s->free = obj;
+    if (s->nfree++ == 0) slab_link(s); // was full
+    if (s->nfree == s->nobjs){
+        slab_unlink(s);
+        slab_page[((char *)s - heap_start) / PAGE_SIZE] = false;
+        heap_free((allocatedBlock *)GET_HEADER(s));
+    }
+}
+
+
+// Whether ptr, returned by mymalloc or myrealloc, is a slab object. No
+// heap block's payload starts in a slab's page, so its page says
+static inline bool is_slab_object(void *ptr){
+    uintptr_t page = (uintptr_t)((char *)ptr - heap_start) / PAGE_SIZE;
+    return page < MAX_HEAP_SIZE / PAGE_SIZE && slab_page[page];
+}
+
+// Slab class of a heap block of blksz bytes, -1 if it is too big for one.
+// Requests are counted toward a slab by their block, so frees match up
+static inline int block_class(size_t blksz){
+    size_t idx = (blksz - WSIZE) / ALIGNMENT;
+    return idx <= SLAB_MAX_SIZE / ALIGNMENT ? slab_class[idx] : -1;
+}
+
+// Count a heap block of blksz bytes handed out (delta 1) or taken back
+// (delta -1) toward its class's first slab. Caller must hold heap_lock.
+static void count_heap_block(size_t blksz, int delta){
+    int cls = block_class(blksz);
+    if (cls < 0 || slab_ready[cls]) return;
+    slab_live[cls] += delta;
+    if (slab_live[cls] * slab_objsz[cls] >= SLAB_MIN_LIVE)
+        __atomic_store_n(&slab_ready[cls], true, __ATOMIC_RELAXED); // mymalloc reads it unlocked
+}
+
+// Whether ptr, returned by mymalloc or myrealloc, is a block in a mapped
+// region, which lies outside the segment's reserved range
+static inline bool is_mapped_block(void *ptr){
+    return (uintptr_t)((char *)ptr - heap_start) >= MAX_SEGMENT_SIZE;
+}
+
+
+/* Function: map_block
+ * -----------------------------------------------------------------------------
+ * Allocate a block for requestedsz in a region of its own, or resize the
+ * mapped block at oldptr if it is not NULL. The payload starts 8 bytes into
+ * the region, after a header with its size and the MAPPED bit.
+ *
+ * Return pointer to the payload, NULL if the region cannot be mapped
+ */
+void *map_block(void *oldptr, size_t requestedsz){
+    size_t numofpage = roundup(requestedsz + ALIGNMENT, PAGE_SIZE) / PAGE_SIZE;
+    char *region;
+    if (oldptr == NULL) region = map_region(numofpage);
+    else region = remap_region((char *)oldptr - ALIGNMENT, numofpage);
+    if (region == NULL) return NULL;
+    PUT(GET_HEADER(region + ALIGNMENT), PACK(numofpage * PAGE_SIZE, MAPPED | ALLOC));
+    return region + ALIGNMENT;
+}
+
+
+// Most objects a tcache bin of class cls may hold
+static inline int tcache_max(int cls){
+    int n = TCACHE_BYTES / slab_objsz[cls];
+    return n > TCACHE_COUNT ? TCACHE_COUNT : n < TCACHE_BATCH ? TCACHE_BATCH : n;
+}
+
+
+/* Function: tcache_flush
+ * -----------------------------------------------------------------------------
+ * Return up to n objects from the front of bin cls of this thread's cache
+ * to their slabs, under one lock.
+ */
+static void tcache_flush(int cls, int n){
+    pthread_mutex_lock(&heap_lock);
+    for (; n > 0 && tcache.bin[cls] != NULL; n--){
+        void *obj = tcache.bin[cls];
+        tcache.bin[cls] = *(void **)obj;
+        tcache.count[cls]--;
+        slab_free(obj);
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+
+/* Function: tcache_exit
+ * -----------------------------------------------------------------------------
+ * Destructor for tcache_key. Gives an exiting thread's cached objects back
+ * to their slabs, unless myinit has discarded that heap since.
+ */
+static void tcache_exit(void *unused){
+    if (tcache.generation != heap_generation) return;
+    for (int cls = 0; cls < NUM_SLAB_CLASSES; cls++) tcache_flush(cls, tcache.count[cls]);
+}
+
+static void tcache_make_key(void){
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+
+
+/* Function: tcache_get
+ * -----------------------------------------------------------------------------
+ * Return this thread's cache, emptied if its objects belong to a heap that
+ * myinit has since discarded.
+ */
+static inline tcache_t *tcache_get(void){
+    unsigned long generation = __atomic_load_n(&heap_generation, __ATOMIC_RELAXED);
+    if (__builtin_expect(tcache.generation != generation, 0)){
+        if (!tcache.registered){ // so its objects are flushed at thread exit
+            pthread_once(&tcache_key_once, tcache_make_key);
+            pthread_setspecific(tcache_key, &tcache);
+            tcache.registered = true;
+        }
+        memset(tcache.bin, 0, sizeof(tcache.bin));
+        memset(tcache.count, 0, sizeof(tcache.count));
+        tcache.generation = generation;
+    }
+    return &tcache;
+}
+
+
 /* Function:mymalloc
  * -----------------------------------------------------------------------------
  * Rounde up requestedsz to ensure 8 byes alignment then allocate in heap. 
+ * Small requests are taken from this thread's cache of slab objects, which
+ * is refilled from the slabs with a batch of objects when it runs out, once
+ * their class has enough live blocks to be worth a slab.
  * Return a pointer to the allocated memory location.
  */
 void *mymalloc(size_t requestedsz)
@@ -311,69 +937,79 @@ void *mymalloc(size_t requestedsz)
     // check for corner cases:
     if (requestedsz <= 0 || requestedsz > INT_MAX) return NULL;
 
-    // Payload need to contain asize+ prev pointer + next pointer
-    // otherwise, when free, no place to contain prev or next!
-    asize = sizeof(size_t) * 2 + roundup(requestedsz, ALIGNMENT); 
+    // Block holds the header and payload, and is big enough to hold the
+    // links and footer once it is freed
+    asize = block_size(requestedsz);
+
+    if (requestedsz <= SLAB_MAX_SIZE){
+        tcache_t *tc = tcache_get();
+        int cls = slab_class[(requestedsz + ALIGNMENT - 1) / ALIGNMENT];
+        void *obj;
+        // the class only ever becomes ready, so a stale read just means a heap block
+        if (tc->bin[cls] == NULL && __atomic_load_n(&slab_ready[block_class(asize)], __ATOMIC_RELAXED)){
+            pthread_mutex_lock(&heap_lock); // refill
+            for (int n = 0; n < TCACHE_BATCH && (obj = slab_alloc(cls)) != NULL; n++){
+                *(void **)obj = tc->bin[cls];
+                tc->bin[cls] = obj;
+                tc->count[cls]++;
+            }
+            pthread_mutex_unlock(&heap_lock);
+        }
+        if (tc->bin[cls] != NULL){
+            obj = tc->bin[cls];
+            tc->bin[cls] = *(void **)obj;
+            tc->count[cls]--;
+            return obj;
+        }
+        // too few for a slab yet, or no room for one: use a heap block
+    }
 
-    // blkptr = find_fit(asize);
-    blkptr = find_fit(asize);
-    if (blkptr != NULL){ // fit found and place it 
-        place(blkptr, asize);
-    }else{// no fit found
-        if (add_page(asize)){
-            //blkptr = find_fit(asize);
-            blkptr = find_fit(asize);
-            place(blkptr, asize);
-        }else{
-            return NULL; 
-            // Heap reaches max. cant request more pages
-        };
+    if (requestedsz >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)) return map_block(NULL, requestedsz);
 
-    }
-    return GET_PAYLOAD_PTR(blkptr);
+    pthread_mutex_lock(&heap_lock);
+    blkptr = heap_alloc(asize);
+    if (blkptr != NULL) count_heap_block(GET_SIZE(blkptr), 1);
+    pthread_mutex_unlock(&heap_lock);
+    return blkptr == NULL ? NULL : GET_PAYLOAD_PTR(blkptr); // NULL when heap reaches max
 }
 
 
 /*
  * Function: coalesce
  * -----------------------------------------------------------------------------
- * Given pointer to a free block. Try to merge with adjacent blocks
- * Will update freelist after coalesce
+ * Given pointer to a free block not on any freelist. Try to merge with
+ * adjacent blocks, removing any merged neighbor from its freelist. The
+ * left block is found through its footer, so only when the prev-alloc bit
+ * says it is free
  *
- * Return the pointer to coalesced free block
+ * Return the pointer to coalesced free block, for the caller to insert
  * */
 
 freeBlock * coalesce(freeBlock * blkptr){
 
-    size_t prev_alloc = GET_ALLOC(LEFT_BLK((blkptr)));
+    size_t prev_alloc = GET_PREV_ALLOC(blkptr);
     size_t next_alloc = GET_ALLOC(RIGHT_BLK(blkptr));
-    size_t payloadsz = GET_SIZE(blkptr);
+    size_t blksz = GET_SIZE(blkptr);
 
     if (prev_alloc && next_alloc) return blkptr; //both left and right blocks are allocated
 
     if (prev_alloc && !next_alloc){ //merge with right block
         freeBlock * rightblkptr = (freeBlock *) RIGHT_BLK(blkptr);
-        payloadsz += GET_SIZE(rightblkptr) + sizeof(size_t) * 2; //addition 16 bytes from merged header and footer
+        blksz += GET_SIZE(rightblkptr);
 
-        delete_node(blkptr);
         delete_node(rightblkptr);
 
-        set_block(blkptr, payloadsz, 0);
-
-        insert_node(blkptr);
+        set_block(blkptr, blksz, prev_alloc);
         return blkptr;
     }
 
     if (!prev_alloc && next_alloc){ //merge with left block
         freeBlock *leftblkptr = (freeBlock *) LEFT_BLK(blkptr);
-        payloadsz += GET_SIZE(leftblkptr) + sizeof(size_t) * 2;//addition 16 bytes from merged header and footer
+        blksz += GET_SIZE(leftblkptr);
 
-        delete_node(blkptr);
         delete_node(leftblkptr);
 
-
-        set_block(leftblkptr, payloadsz, 0);
-        insert_node(leftblkptr);
+        set_block(leftblkptr, blksz, GET_PREV_ALLOC(leftblkptr));
         return leftblkptr;
     }
 
@@ -381,14 +1017,12 @@ freeBlock * coalesce(freeBlock * blkptr){
         freeBlock *leftblkptr = (freeBlock *) LEFT_BLK(blkptr);
         freeBlock *rightblkptr = (freeBlock *) RIGHT_BLK(blkptr);
 
-        payloadsz += GET_SIZE(leftblkptr) + GET_SIZE(rightblkptr) + sizeof(size_t) * 4;// additional bytes from merged headers and footers
+        blksz += GET_SIZE(leftblkptr) + GET_SIZE(rightblkptr);
 
-        delete_node(blkptr);
         delete_node(leftblkptr);
         delete_node(rightblkptr);
 
-        set_block(leftblkptr, payloadsz,0);
-        insert_node(leftblkptr);
+        set_block(leftblkptr, blksz, GET_PREV_ALLOC(leftblkptr));
         return leftblkptr;
     }
     return NULL;
@@ -402,20 +1036,122 @@ freeBlock * coalesce(freeBlock * blkptr){
  *
  * Invalid requests like frees an already freed ptr, overruns past the end of 
  * an allocated block or other incorrect  usage. free will do nothing.
+ * A heap block of up to QUICK_MAX_SIZE bytes goes on a quick list, to be
+ * coalesced later with the others in bulk, unless it has a free neighbor:
+ * holding it back would then keep that free block from growing.
  */
 void myfree(void *ptr)
 {
     // Do nothing when ptr == NULL
     if (ptr == NULL) return;
 
+    if (is_mapped_block(ptr)){
+        unmap_region((char *)ptr - ALIGNMENT);
+        return;
+    }
+
+    if (is_slab_object(ptr)){ // keep it in this thread's cache
+        tcache_t *tc = tcache_get();
+        int cls = SLAB_OF(ptr)->cls;
+        *(void **)ptr = tc->bin[cls];
+        tc->bin[cls] = ptr;
+        if (++tc->count[cls] > tcache_max(cls)) tcache_flush(cls, TCACHE_BATCH);
+        return;
+    }
+
     // Unpack
     allocatedBlock* blkptr = (allocatedBlock *)GET_HEADER(ptr);
-    size_t payloadsz = GET_SIZE(blkptr);
+    pthread_mutex_lock(&heap_lock);
+    count_heap_block(GET_SIZE(blkptr), -1);
+    if (GET_SIZE(blkptr) <= QUICK_MAX_SIZE && GET_PREV_ALLOC(blkptr) && GET_ALLOC(RIGHT_BLK(blkptr)))
+        quick_free(blkptr);
+    else heap_free(blkptr);
+    pthread_mutex_unlock(&heap_lock);
+}
+
+
+/*
+ * Function: mymalloc_usable_size
+ * -----------------------------------------------------------------------------
+ * Given pointer to payload of previously allocated block, return how many
+ * bytes of it the client may use: the object size for a slab object, the
+ * whole payload for a heap block. 0 for NULL.
+ */
+size_t mymalloc_usable_size(void *ptr)
+{
+    if (ptr == NULL) return 0;
+    if (is_mapped_block(ptr)) return GET_SIZE(GET_HEADER(ptr)) - ALIGNMENT;
+    if (is_slab_object(ptr)) return SLAB_OF(ptr)->objsz;
+    // a neighbor may be updating the prev-alloc bit under the lock
+    return (__atomic_load_n((uint32_t *)GET_HEADER(ptr), __ATOMIC_RELAXED) & ~0x7) - WSIZE;
+}
+
+
+/* Fucntion: shrink_block
+ * -----------------------------------------------------------------------------
+ * Trim an allocated block to payload asize if the tail left over is big
+ * enough to be a free block, and free the tail, merged with a free right
+ * neighbor. Caller must hold heap_lock.
+ */
+void shrink_block(allocatedBlock *blkptr, size_t asize){
+    size_t csize = GET_SIZE(blkptr);
+    if (csize - asize < MINBLKSZ) return;
+
+    set_block(blkptr, asize, ALLOC | GET_PREV_ALLOC(blkptr));
+    allocatedBlock *restblk = (allocatedBlock *) RIGHT_BLK(blkptr);
+    set_block(restblk, csize - asize, ALLOC | PREV_ALLOC);
+    heap_free(restblk);
+}
+
+
+/* Function: resize_block
+ * -----------------------------------------------------------------------------
+ * Resize the heap block with payload at ptr to payload asize without
+ * moving to another block. A shrinking block gives back its tail. A growing
+ * block absorbs a free right neighbor, and failing that a free left
+ * neighbor too, sliding its contents down. If that is not enough and the
+ * block (or its free right neighbor) is last before the epilogue, the heap
+ * is grown under it, but only when no free block elsewhere could take it,
+ * as malloc would otherwise have used that block. Caller must hold heap_lock.
+ *
+ * Return the payload of the resized block, NULL if it cannot grow in place
+ */
+void *resize_block(void *ptr, size_t asize){
+    allocatedBlock *blkptr = (allocatedBlock *)GET_HEADER(ptr);
+    size_t csize = GET_SIZE(blkptr);
+    if (csize >= asize){
+        shrink_block(blkptr, asize);
+        return ptr;
+    }
+
+    char *right = RIGHT_BLK(blkptr);
+    size_t avail = csize; // block size if merged with free neighbors
+    if (!GET_ALLOC(right)) avail += GET_SIZE(right);
+    if (avail >= asize){
+        if (!GET_ALLOC(right)) delete_node((freeBlock *)right);
+        set_allocated(blkptr, avail);
+        shrink_block(blkptr, asize);
+        return ptr;
+    }
 
-    set_block(blkptr, payloadsz,0);
+    if (!GET_PREV_ALLOC(blkptr) && GET_SIZE(LEFT_BLK(blkptr)) + avail >= asize){
+        char *left = LEFT_BLK(blkptr);
+        delete_node((freeBlock *)left);
+        if (!GET_ALLOC(right)) delete_node((freeBlock *)right);
+        set_allocated(left, GET_SIZE(left) + avail);
+        memmove(GET_PAYLOAD_PTR(left), ptr, csize - WSIZE);
+        shrink_block((allocatedBlock *)left, asize);
+        return GET_PAYLOAD_PTR(left);
+    }
 
-    // insert_node
-    insert_node((freeBlock *)blkptr);
+    bool last = GET_SIZE(GET_ALLOC(right) ? right : RIGHT_BLK(right)) == 0; // next to epilogue
+    if (!last || find_fit(asize) != NULL || add_page(asize - avail) == NULL) return NULL;
+    // the new pages were coalesced into a free right neighbor
+    right = RIGHT_BLK(blkptr);
+    delete_node((freeBlock *)right);
+    set_allocated(blkptr, csize + GET_SIZE(right));
+    shrink_block(blkptr, asize);
+    return ptr;
 }
 
 
@@ -424,28 +1160,67 @@ void myfree(void *ptr)
  * -----------------------------------------------------------------------------
  * Given pointer to payload of previously allocated block and new size.Change
  * the size of memory blok to new size. The content will be unchanged.
+ * A heap block is resized in place when its neighbors allow; otherwise the
+ * block moves to a new one, with room to grow.
  * Return pointer to memory location
  */
 void *myrealloc(void *oldptr, size_t newsz)
 {
     // corner cases
-    if (newsz <= 0 ) return NULL;
     if (oldptr == NULL) return mymalloc(newsz);
-    if (newsz == 0) myfree(oldptr);
+    if (newsz == 0){
+        myfree(oldptr);
+        return NULL;
+    }
+    if (newsz > INT_MAX) return NULL;
+
+    size_t oldsize = mymalloc_usable_size(oldptr);
+    size_t mmap_min = __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
+    if (is_mapped_block(oldptr)){
+        if (newsz >= mmap_min) return map_block(oldptr, newsz); // no copy
+    }else if (is_slab_object(oldptr)){
+        if (oldsize >= newsz) return oldptr; // object is big enough for realloc
+    }else{
+        size_t asize = block_size(newsz);
+        pthread_mutex_lock(&heap_lock);
+        size_t oldblksz = GET_SIZE(GET_HEADER(oldptr));
+        void *newptr = resize_block(oldptr, asize);
+        if (newptr != NULL){
+            count_heap_block(oldblksz, -1);
+            count_heap_block(GET_SIZE(GET_HEADER(newptr)), 1);
+        }
+        pthread_mutex_unlock(&heap_lock);
+        if (newptr != NULL) return newptr;
+    }
 
-    int asize = sizeof(size_t) * 2 + roundup(newsz, 8);
-    allocatedBlock * oldblk = (allocatedBlock *) ( (char *)oldptr - sizeof(size_t)); 
-    int oldsize = GET_SIZE(oldblk);
-    if (oldsize >= asize) return oldptr; // original block is big enough for relloc
+    // Malloc to new location, copy original content, then free the old one.
+    // Room to grow is only worth leaving in the heap, mapped blocks remap
+    void *newptr = mymalloc(newsz < mmap_min ? newsz * REALLOC_FACTOR : newsz);
+    if (newptr == NULL && (newptr = mymalloc(newsz)) == NULL) return NULL;
+    memcpy(newptr, oldptr, MIN(oldsize, newsz));
+    myfree(oldptr);
+    return newptr;
+}
 
-    char buffer[oldsize]; // store old date in a buffer to prevent overwritten
-    memcpy(buffer, oldptr, oldsize);
-    myfree(oldptr); //free oldptr
 
-    // Malloc to new location and copy original content
-    void *newptr = mymalloc(newsz * REALLOC_FACTOR);
-    memcpy(newptr, buffer, MIN(oldsize, asize));
-    return newptr;
+/*
+ * Function: mymallopt
+ * -----------------------------------------------------------------------------
+ * Set one of the parameters controlling when memory is given back to the
+ * OS or using mapped regions. Settings last across myinit.
+ */
+bool mymallopt(int param, size_t value)
+{
+    size_t *target;
+    switch (param){
+        case MYMALLOC_TRIM_THRESHOLD: target = &trim_threshold; break;
+        case MYMALLOC_TOP_PAD: target = &top_pad; break;
+        case MYMALLOC_RELEASE_THRESHOLD: target = &release_threshold; break;
+        case MYMALLOC_MMAP_THRESHOLD: target = &mmap_threshold; break;
+        default: return false;
+    }
+    __atomic_store_n(target, value, __ATOMIC_RELAXED);
+    return true;
 }
 
 
@@ -458,56 +1233,155 @@ void *myrealloc(void *oldptr, size_t newsz)
 bool validate_addr(freeBlock *ptr){
     void *blkptr = (void *) ptr;
     if (blkptr == NULL) return true;
-    return blkptr > (void *)0x1070000000 && blkptr < (void *)(0x1070000000+ PAGE_SIZE * pagecnt);
+    return blkptr > (void *)heap_start && blkptr < (void *)(heap_start + PAGE_SIZE * pagecnt);
 
 }
 
 /*
  * Function: check_freelist
  * -----------------------------------------------------------------------------
- * Iterate through non null freelist and print valudes. Used for validate_heap
+ * Iterate through every freelist and check each node, and that the bitmaps
+ * agree with which lists are non-empty. Prints only the problems found.
  * Used for validate_heap
  */
 
 bool check_freelist(){
-    size_t bucketidx = 0;
     freeBlock *cur; 
     int invalidcnt = 0;
 
-    printf("now checking  all free lists\n");
-    printf("---------------------------------------\n");
-    for (size_t i = bucketidx; i < NUM_BUCKETS;i++){
+    for (int fl = 0; fl < NUM_FL; fl++){
+        for (int sl = 0; sl < NUM_SL; sl++){
+            bool marked = (fl_bitmap >> fl & 1) && (sl_bitmap[fl] >> sl & 1);
+            if (marked != (freelist_arr[fl][sl] != NULL)){
+                printf("\tbitmap says list [%d][%d] is %s\n", fl, sl, marked ? "non-empty" : "empty");
+                invalidcnt++;
+            }
+            for (cur = freelist_arr[fl][sl]; cur != NULL; cur = blk_at(cur->next)){
+
+                if (!validate_addr(cur)){
+                    printf("\tinvalid cur addr: %p\n", (void *)cur);
+                    invalidcnt++;
+                    break; // cannot follow the list any further
+                }
+                if (!validate_addr(blk_at(cur->next))){
+                    printf("\tinvalid cur->next offset: %u\n", cur->next);
+                    invalidcnt++;
+                    break;
+                }
+                if (!validate_addr(blk_at(cur->prev))){
+                    printf("\tinvalid cur->prev offset: %u\n", cur->prev);
+                    invalidcnt++;
+                }
+
+                if (GET_SIZE(cur) < MINBLKSZ || GET_ALLOC(cur)){
+                    printf("\tinvalid header: %u\n", cur->header);
+                    invalidcnt++;
+                    continue; // size cannot be trusted to find the footer
+                }
+                if (GET(cur) != GET(FTRP(cur))){
+                    printf("\theader footer not equal!\n");
+                    invalidcnt++;
+                }
+                // coalescing leaves no free block next to another
+                if (!GET_PREV_ALLOC(cur) || !GET_ALLOC(RIGHT_BLK(cur)) || GET_PREV_ALLOC(RIGHT_BLK(cur))){
+                    printf("\tblock %p not between allocated blocks that know it is free\n", (void *)cur);
+                    invalidcnt++;
+                }
+                int curfl, cursl;
+                mapping_insert(GET_SIZE(cur), &curfl, &cursl);
+                if (curfl != fl || cursl != sl){
+                    printf("\tblock %p of size %u on list [%d][%d]\n", (void *)cur, GET_SIZE(cur), fl, sl);
+                    invalidcnt++;
+                }
+            }
+        }
+    }
+    if (invalidcnt != 0){
+        printf("**********OMG freelist invalid ********** !\n");
+    }
+
+    return invalidcnt == 0;
+}
 
-        printf("\t now checking  bucketidx %zu, list head is %p\n", i,(void *) freelist_arr[i]);
-        for (cur = freelist_arr[i]; cur != NULL; cur = cur->next){
 
-            if (!validate_addr(cur)){
-                printf("\tinvalid cur addr: %p\n", (void *)cur);
+/*
+ * Function: check_slabs
+ * -----------------------------------------------------------------------------
+ * Walk every partial slab and check its header, and that its free objects
+ * lie on object boundaries inside it and add up to its free count. Prints
+ * only the problems found. Used for validate_heap
+ */
+bool check_slabs(){
+    int invalidcnt = 0;
+
+    for (int cls = 0; cls < NUM_SLAB_CLASSES; cls++){
+        for (slab *s = partial_slabs[cls]; s != NULL; s = s->next){
+            if (!validate_addr((freeBlock *)s) || !is_slab_object(s)){
+                printf("	slab %p of class %d is not a slab page\n", (void *)s, cls);
                 invalidcnt++;
+                break;
             }
-            if (!validate_addr(cur->next)){
-                printf("\tinvalid cur->next addr: %p\n", (void *)cur->next);
+            if (s->cls != cls || s->objsz != slab_objsz[cls] || s->nfree == 0 || s->nfree > s->nobjs){
+                printf("	slab %p on list %d: class %d, objsz %u, %u of %u free\n",
+                        (void *)s, cls, s->cls, s->objsz, s->nfree, s->nobjs);
                 invalidcnt++;
+                continue;
             }
-            if (!validate_addr(cur->prev)){
-                printf("\tinvalid cur->prev addr: %p\n", (void *)cur->prev);
+            char *first = (char *)s + roundup(sizeof(slab), ALIGNMENT);
+            unsigned nfree = (first + s->nobjs * s->objsz - s->unused) / s->objsz;
+            for (char *obj = s->free; obj != NULL && nfree <= s->nobjs; obj = *(char **)obj, nfree++){
+                if (obj < first || obj >= s->unused || (obj - first) % s->objsz != 0){
+                    printf("	slab %p has bad free object %p\n", (void *)s, (void *)obj);
+                    invalidcnt++;
+                    break;
+                }
+            }
+            if (nfree != s->nfree){
+                printf("	slab %p counts %u free objects, found %u\n", (void *)s, s->nfree, nfree);
                 invalidcnt++;
             }
+        }
+    }
+    if (invalidcnt != 0){
+        printf("**********OMG slabs invalid ********** !\n");
+    }
 
-            if (GET(cur) <= 0 || GET(cur) / 2 == 1 || GET(cur) > INT_MAX){
-                printf("\tinvalid header: %zu\n", cur->header);
+    return invalidcnt == 0;
+}
+
+
+/*
+ * Function: check_quicklists
+ * -----------------------------------------------------------------------------
+ * Walk every quick list and check that its blocks are marked allocated and
+ * of the list's size, and that they add up to quick_bytes. Prints only the
+ * problems found. Used for validate_heap
+ */
+bool check_quicklists(){
+    int invalidcnt = 0;
+    size_t bytes = 0;
+
+    for (int i = 0; i <= QUICK_MAX_SIZE / ALIGNMENT; i++){
+        // stop early on a cycle, which would make the count too big
+        for (freeBlock *cur = quick_lists[i]; cur != NULL && bytes <= quick_bytes; cur = blk_at(cur->next)){
+            if (!validate_addr(cur)){
+                printf("\tinvalid quick block addr: %p\n", (void *)cur);
                 invalidcnt++;
+                break;
             }
-            if (GET(cur) != GET(FTRP(cur))){
-                printf("\theader footer not equal!");
+            if (!GET_ALLOC(cur) || GET_SIZE(cur) != (size_t)i * ALIGNMENT){
+                printf("\tquick block %p with header %u on list %d\n", (void *)cur, cur->header, i);
                 invalidcnt++;
             }
+            bytes += GET_SIZE(cur);
         }
     }
-    if (invalidcnt == 0){
-        printf("freelist valid !\n");
-    }else{
-        printf("**********OMG freelist invalid ********** !\n");
+    if (bytes != quick_bytes){
+        printf("\tquick lists count %zu bytes, found %zu\n", quick_bytes, bytes);
+        invalidcnt++;
+    }
+    if (invalidcnt != 0){
+        printf("**********OMG quick lists invalid ********** !\n");
     }
 
     return invalidcnt == 0;
@@ -517,20 +1391,22 @@ bool check_freelist(){
 /*
  * Function: print_freelist
  * -----------------------------------------------------------------------------
- * Iterate through non null freelist and print valudes. Used for validate_heap
+ * Iterate through non null freelist and print valudes. Not called by
+ * validate_heap, call it from a debugger to see the lists.
  */
 void print_freelist(){
-    size_t bucketidx = 0;
     freeBlock *cur; 
 
     printf("now printing all free lists\n");
     printf("---------------------------------------\n");
-    for (size_t i = bucketidx; i < NUM_BUCKETS;i++){
-        printf("\t now print bucketidx %zu, list head is %p\n", i,(void *) freelist_arr[i]);
-        for (cur = freelist_arr[i]; cur != NULL; cur = cur->next){
-            printf("\t\tcur: %p, cur->header: %zu, cur->prev: %p, cur->next: %p\n",
-                    (void *)cur, cur->header, (void *)cur->prev, (void *) cur->next);
-
+    for (int fl = 0; fl < NUM_FL; fl++){
+        for (int sl = 0; sl < NUM_SL; sl++){
+            if (freelist_arr[fl][sl] == NULL) continue;
+            printf("\t now print list [%d][%d], list head is %p\n", fl, sl, (void *) freelist_arr[fl][sl]);
+            for (cur = freelist_arr[fl][sl]; cur != NULL; cur = blk_at(cur->next)){
+                printf("\t\tcur: %p, cur->header: %u, cur->prev: %p, cur->next: %p\n",
+                        (void *)cur, cur->header, (void *)blk_at(cur->prev), (void *)blk_at(cur->next));
+            }
         }
     }
 
@@ -545,8 +1421,10 @@ void print_freelist(){
  */
 bool validate_heap()
 {
+    pthread_mutex_lock(&heap_lock);
     validatecnt++;
-    print_freelist();
-    return check_freelist();
+    bool valid = check_freelist() && check_quicklists() && check_slabs();
+    pthread_mutex_unlock(&heap_lock);
+    return valid;
 }
 
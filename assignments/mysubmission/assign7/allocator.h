@@ -41,6 +41,34 @@ void *myrealloc(void *ptr, size_t size);
 void myfree(void *ptr);
 
 
+/* Function: mymalloc_usable_size
+ * -------------------------------
+ * Returns the number of bytes usable at ptr, which must have been returned
+ * by mymalloc or myrealloc and not yet freed. This is at least the size
+ * requested, and the block can be resized up to it without moving.
+ * Returns 0 for NULL.
+ */
+size_t mymalloc_usable_size(void *ptr);
+
+
+/* Function: mymallopt
+ * --------------------
+ * Sets one of the allocator's size parameters, in bytes, in the manner of
+ * mallopt. Requests of MYMALLOC_MMAP_THRESHOLD bytes or more are each
+ * given a region of memory of their own instead of space in the heap.
+ * When freeing leaves a free block of MYMALLOC_TRIM_THRESHOLD bytes or
+ * more at the end of the heap, the heap is shrunk to leave
+ * MYMALLOC_TOP_PAD bytes free there; the gap between the two keeps the
+ * heap from shrinking and growing on every request. Whole pages inside
+ * any other free block of MYMALLOC_RELEASE_THRESHOLD bytes or more are
+ * given back while the block stays free. Setting a threshold to SIZE_MAX
+ * turns that off. Returns false if param is unknown.
+ */
+enum { MYMALLOC_TRIM_THRESHOLD, MYMALLOC_TOP_PAD,
+       MYMALLOC_RELEASE_THRESHOLD, MYMALLOC_MMAP_THRESHOLD };
+bool mymallopt(int param, size_t value);
+
+
 /* Function: validate_heap
  * -----------------------
  * This is the hook for your heap consistency checker. Returns true
@@ -11,6 +11,7 @@
 #define _GNU_SOURCE
 #include <dirent.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdarg.h>
@@ -19,8 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <valgrind/callgrind.h>
+#include <x86intrin.h>
 
 #include "allocator.h"
 #include "fcyc.h"
@@ -80,13 +83,60 @@ typedef struct {
     int tput;           // expressed in Kreq/sec
 } result_t;
 
-typedef enum { Correctness = 1, Performance = 2 } flags_t;
+typedef enum { Correctness = 1, Performance = 2, Latency = 4, Residency = 8 } flags_t;
+
+// Latency histogram buckets are powers of 2 cycles, the last is open-ended
+#define LATENCY_BUCKETS 24
+
+// Per-request latency counts for each kind of request, across all scripts
+typedef struct {
+    long counts[REALLOC + 1][LATENCY_BUCKETS];
+    uint64_t max[REALLOC + 1];
+} latency_t;
+
+// Number of points through a script at which resident memory is sampled
+#define RSS_SAMPLES 20
+
+// Heap segment size and resident memory sampled through one script
+typedef struct {
+    int nsamples;
+    int request[RSS_SAMPLES + 1];   // requests made before the sample
+    size_t segment[RSS_SAMPLES + 1];
+    long rss[RSS_SAMPLES + 1];      // bytes resident, less those before myinit
+} residency_t;
+
+// Thread counts the scaling test is run with, 1, 2, 4, ... up to -t N
+#define MAX_THREAD_COUNTS 16
+
+// Total requests and wall time for each thread count, across all scripts
+typedef struct {
+    int nthreads[MAX_THREAD_COUNTS];
+    long num_ops[MAX_THREAD_COUNTS];
+    double secs[MAX_THREAD_COUNTS];
+    int errors;     // blocks found overwritten by another thread
+    int ncounts;
+} scaling_t;
+
+// packs the params to one thread replaying a script in the scaling test
+typedef struct {
+    script_t *script;
+    block_t *blocks;    // this thread's blocks, indexed by id
+    unsigned char tag;  // byte this thread writes at both ends of its blocks
+    int errors;
+    bool failed;        // allocator returned NULL
+} threaddata_t;
 
 static void get_scripts(char *path, char files[][PATH_MAX], int max, int *pcount);
 static void parse_script(char *filename, script_t *script);
-static void run_scripts(char paths[][PATH_MAX], int n, flags_t flags);
+static void run_scripts(char paths[][PATH_MAX], int n, flags_t flags, int nthreads);
 static bool eval_correctness(script_t *script);
 static void eval_performance(void *data);
+static void eval_latency(script_t *script, latency_t *lat);
+static void print_latency(const latency_t *lat);
+static void eval_residency(script_t *script, residency_t *res);
+static void print_residency(const char *name, const residency_t *res);
+static void eval_scaling(script_t *script, scaling_t *sc);
+static void print_scaling(const scaling_t *sc);
 static bool verify_block(void *ptr, size_t size, script_t *script, int lineno);
 static bool verify_payload(void *ptr, size_t size, int id, script_t *script, int lineno, char *op);
 static void print_table(result_t result[], int n, flags_t which);
@@ -106,7 +156,10 @@ int main(int argc, char *argv[])
     int nscripts = 0;
 
     CALLGRIND_TOGGLE_COLLECT ;// turn off profiling while we do the setup work, later turn on during simulation
-    while ((c = getopt(argc, argv, "f:pc")) != EOF) {
+    bool latency = false;
+    int nthreads = 0;
+    bool residency = false;
+    while ((c = getopt(argc, argv, "f:pclrt:")) != EOF) {
         switch (c) {
             case 'f':
                 get_scripts(optarg, paths, sizeof(paths)/sizeof(paths[0]), &nscripts);
@@ -117,16 +170,27 @@ int main(int argc, char *argv[])
             case 'c':
                 flags = Correctness;
                 break;
+            case 'l':
+                latency = true;
+                break;
+            case 'r':
+                residency = true;
+                break;
+            case 't':
+                if ((nthreads = atoi(optarg)) < 1) usage();
+                break;
             default:
                 usage();
         }
     }
     if (optind < argc) usage();
+    if (latency) flags |= Latency;
+    if (residency) flags |= Residency;
     if (nscripts == 0)
         get_scripts(DEFAULT_SCRIPT_DIR, paths, sizeof(paths)/sizeof(paths[0]), &nscripts);
     qsort(paths, nscripts, sizeof(paths[0]), cmpbase); // sort by filename
     setvbuf(stdout, NULL, _IONBF, 0); // disable stdout buffering, all printfs display to terminal immediately
-    run_scripts(paths, nscripts, flags);
+    run_scripts(paths, nscripts, flags, nthreads);
     return 0;
 }
 
@@ -166,11 +230,20 @@ static void get_scripts(char *path, char files[][PATH_MAX], int max, int *pcount
  * Runs a set of scripts against the allocator.  It loops script-by-script.
  * For each script, runs once for correctness (unless flags are perf only)
  * and if had no correctness errors, runs a performance trial on the same script.
- * Records results into an array, which is printed at end.
+ * Records results into an array, which is printed at end. If nthreads is
+ * non-zero, also replays each valid script concurrently in up to nthreads
+ * threads.
  */
-static void run_scripts(char paths[][PATH_MAX], int n, flags_t which)
+static void run_scripts(char paths[][PATH_MAX], int n, flags_t which, int nthreads)
 {
     result_t result[n];
+    residency_t res[n];
+    latency_t lat;
+    memset(&lat, 0, sizeof(lat));
+    scaling_t sc = {.ncounts = 0};
+    for (int t = 1; t < nthreads && sc.ncounts < MAX_THREAD_COUNTS - 1; t *= 2)
+        sc.nthreads[sc.ncounts++] = t;
+    if (nthreads > 0) sc.nthreads[sc.ncounts++] = nthreads;
 
     for (int i = 0; i < n; i++) {
         script_t script;
@@ -186,11 +259,22 @@ static void run_scripts(char paths[][PATH_MAX], int n, flags_t which)
         } else {
             result[i].secs = result[i].utilization = 0;
         }
+        if (result[i].valid && (which & Latency))
+            eval_latency(&script, &lat);
+        res[i].nsamples = 0;
+        if (result[i].valid && (which & Residency))
+            eval_residency(&script, &res[i]);
+        if (result[i].valid && nthreads > 0)
+            eval_scaling(&script, &sc);
         printf("done.\n");
         free(script.ops);
         free(script.blocks);
     }
     print_table(result, n, which); // display results
+    if (which & Latency) print_latency(&lat);
+    for (int i = 0; i < n; i++)
+        if (res[i].nsamples > 0) print_residency(result[i].name, &res[i]);
+    if (nthreads > 0) print_scaling(&sc);
 }
 
 
@@ -403,8 +487,10 @@ static void eval_performance(void *data)
         }
 
         // peak util is ratio of inuse/segment, reset when either changes (numerator or denom)
-        if (heap_segment_size() > max_segment_size || (cur_payload_size > peak_payload_size) ) {
-            max_segment_size = heap_segment_size();
+        // blocks the allocator mapped outside the segment count as segment
+        size_t segment_size = heap_segment_size() + mapped_region_size();
+        if (segment_size > max_segment_size || (cur_payload_size > peak_payload_size) ) {
+            max_segment_size = segment_size;
             peak_payload_size = cur_payload_size;
         } 
      }
@@ -415,13 +501,243 @@ static void eval_performance(void *data)
 
 
 
+/* Function: eval_latency
+ * -----------------------
+ * Runs the script once more, reading the cycle counter around each
+ * request, and adds each request's latency to the histogram for its kind.
+ * Unlike eval_performance, which reports the average, this shows the
+ * spread and the worst case. The counter reads themselves add a few dozen
+ * cycles to every request.
+ */
+static void eval_latency(script_t *script, latency_t *lat)
+{
+    myinit();
+    memset(script->blocks, 0, script->num_ids*sizeof(script->blocks[0]));
+
+    for (int line = 0; line < script->num_ops;  line++) {
+        int id = script->ops[line].id;
+        size_t requested_size = script->ops[line].size;
+        int op = script->ops[line].op;
+        uint64_t start = __rdtsc();
+
+        switch (op) {
+            case ALLOC:
+                script->blocks[id].ptr = mymalloc(requested_size);
+                break;
+            case REALLOC:
+                script->blocks[id].ptr = myrealloc(script->blocks[id].ptr, requested_size);
+                break;
+            case FREE:
+                myfree(script->blocks[id].ptr);
+                script->blocks[id].ptr = NULL;
+                break;
+        }
+        uint64_t cycles = __rdtsc() - start;
+        int bucket = cycles < 2 ? 0 : 63 - __builtin_clzl(cycles);
+        lat->counts[op][bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+        if (cycles > lat->max[op]) lat->max[op] = cycles;
+    }
+}
+
+/* Function: print_latency
+ * -----------------------
+ * Prints the latency histogram, one row per power-of-2 range of cycles
+ * that any request fell into, and the worst case for each kind.
+ */
+static void print_latency(const latency_t *lat)
+{
+    printf(" latency (cycles)        malloc         free      realloc\n");
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        if (lat->counts[ALLOC][b] + lat->counts[FREE][b] + lat->counts[REALLOC][b] == 0) continue;
+        char range[32];
+        if (b == LATENCY_BUCKETS - 1) sprintf(range, "%lu+", 1UL << b);
+        else sprintf(range, "%lu-%lu", b == 0 ? 0 : 1UL << b, (2UL << b) - 1);
+        printf("%17s %13ld %12ld %12ld\n", range, lat->counts[ALLOC][b], lat->counts[FREE][b], lat->counts[REALLOC][b]);
+    }
+    printf("%17s %13lu %12lu %12lu\n\n", "max", lat->max[ALLOC], lat->max[FREE], lat->max[REALLOC]);
+}
+
+
+/* Function: resident_bytes
+ * ------------------------
+ * Returns the bytes of this process's memory currently resident, as the
+ * kernel reports in /proc/self/statm, or 0 if that can't be read.
+ */
+static long resident_bytes(void)
+{
+    long pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%*s %ld", &pages) != 1) pages = 0;
+    fclose(fp);
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+/* Function: eval_residency
+ * ------------------------
+ * Runs the script once more, sampling the heap segment size (plus regions
+ * the allocator mapped outside it) and the memory
+ * resident in the process at RSS_SAMPLES evenly spaced points and at the
+ * end, to show how much memory the allocator gives back after a burst.
+ * The resident memory before myinit is subtracted out.
+ */
+static void eval_residency(script_t *script, residency_t *res)
+{
+    myinit();
+    memset(script->blocks, 0, script->num_ids*sizeof(script->blocks[0]));
+    long base = resident_bytes();
+    int every = script->num_ops / RSS_SAMPLES + 1;
+
+    res->nsamples = 0;
+    for (int line = 0; line <= script->num_ops;  line++) {
+        if (line % every == 0 || line == script->num_ops) {
+            res->request[res->nsamples] = line;
+            res->segment[res->nsamples] = heap_segment_size() + mapped_region_size();
+            res->rss[res->nsamples++] = resident_bytes() - base;
+        }
+        if (line == script->num_ops) break;
+
+        int id = script->ops[line].id;
+        size_t requested_size = script->ops[line].size;
+        switch (script->ops[line].op) {
+            case ALLOC:
+                script->blocks[id].ptr = mymalloc(requested_size);
+                if (requested_size) memset(script->blocks[id].ptr, 0xab, requested_size);
+                break;
+            case REALLOC:
+                script->blocks[id].ptr = myrealloc(script->blocks[id].ptr, requested_size);
+                if (requested_size) memset(script->blocks[id].ptr, 0xcd, requested_size);
+                break;
+            case FREE:
+                myfree(script->blocks[id].ptr);
+                script->blocks[id].ptr = NULL;
+                break;
+        }
+    }
+}
+
+/* Function: print_residency
+ * -------------------------
+ * Prints the heap segment size and resident memory sampled through a script.
+ */
+static void print_residency(const char *name, const residency_t *res)
+{
+    printf(" %-16s   requests   segment+mapped (KB)   resident (KB)\n", name);
+    for (int i = 0; i < res->nsamples; i++)
+        printf("%29d %21zu %15ld\n", res->request[i], res->segment[i] / 1024, res->rss[i] / 1024);
+    printf("\n");
+}
+
+/* Function: replay_thread
+ * ------------------------
+ * Thread function for the scaling test. Replays the script on this
+ * thread's own set of blocks, marking the first and last byte of each with
+ * the thread's tag and counting blocks whose marks have changed by the time
+ * they are realloc'ed or freed, which means another thread was handed
+ * overlapping memory.
+ */
+static void *replay_thread(void *data)
+{
+    threaddata_t *td = data;
+    script_t *script = td->script;
+    block_t *blocks = td->blocks;
+
+    for (int line = 0; line < script->num_ops; line++) {
+        int id = script->ops[line].id;
+        size_t requested_size = script->ops[line].size;
+        unsigned char *p = blocks[id].ptr;
+
+        if (script->ops[line].op != ALLOC && blocks[id].size != 0 &&
+            (p[0] != td->tag || p[blocks[id].size-1] != td->tag))
+            td->errors++;
+        switch (script->ops[line].op) {
+            case ALLOC:
+                p = mymalloc(requested_size);
+                break;
+            case REALLOC:
+                p = myrealloc(p, requested_size);
+                break;
+            case FREE:
+                myfree(p);
+                p = NULL;
+                requested_size = 0;
+                break;
+        }
+        if (p == NULL && requested_size != 0) {
+            td->failed = true;
+            return NULL;
+        }
+        if (requested_size) p[0] = p[requested_size-1] = td->tag;
+        blocks[id] = (block_t){.ptr = p, .size = requested_size};
+    }
+    return NULL;
+}
+
+/* Function: eval_scaling
+ * ----------------------
+ * For each thread count in sc, resets the heap and replays the whole script
+ * in that many threads at once, adding the requests made and the wall time
+ * taken to the totals for that count.
+ */
+static void eval_scaling(script_t *script, scaling_t *sc)
+{
+    for (int c = 0; c < sc->ncounts; c++) {
+        int n = sc->nthreads[c];
+        pthread_t tids[n];
+        threaddata_t td[n];
+        struct timespec start, end;
+
+        myinit();
+        for (int t = 0; t < n; t++) {
+            td[t] = (threaddata_t){.script = script, .tag = 0x80 | t};
+            if ((td[t].blocks = calloc(script->num_ids, sizeof(block_t))) == NULL)
+                fatal_error("Libc heap exhausted. Cannot continue.\n");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < n; t++)
+            if (pthread_create(&tids[t], NULL, replay_thread, &td[t]) != 0)
+                fatal_error("Could not create thread.\n");
+        for (int t = 0; t < n; t++)
+            pthread_join(tids[t], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        for (int t = 0; t < n; t++) {
+            if (td[t].failed)
+                allocator_error(script, 0, "malloc or realloc returned NULL in thread %d of %d", t, n);
+            sc->errors += td[t].errors;
+            free(td[t].blocks);
+        }
+        sc->num_ops[c] += (long)n * script->num_ops;
+        sc->secs[c] += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+}
+
+/* Function: print_scaling
+ * -----------------------
+ * Prints the aggregate throughput for each thread count and its speedup
+ * over one thread.
+ */
+static void print_scaling(const scaling_t *sc)
+{
+    printf(" threads     requests           secs       Kreq/sec    speedup\n");
+    double base = sc->num_ops[0] / sc->secs[0];
+    for (int c = 0; c < sc->ncounts; c++) {
+        double tput = sc->num_ops[c] / sc->secs[c];
+        printf("%8d %12ld %14.6f %14.0f %9.2fx\n", sc->nthreads[c], sc->num_ops[c], sc->secs[c], tput / 1e3, tput / base);
+    }
+    if (sc->errors != 0)
+        printf("%d block%s overwritten by another thread.\n", sc->errors, sc->errors > 1 ? "s were" : " was");
+    printf("\n");
+}
+
+
 /* Function: verify_block
  * ----------------------
  * Does some simple checks on the block returned by allocator to try to
  * verify correctness.  If any problem shows up, reports an allocator error
  * with details and line from script file. The checks it performs are:
  *  -- verify block address is correctly aligned
- *  -- verify block address is within heap segment
+ *  -- verify block address is within heap segment or a mapped region
  *  -- verify block address + size doesn't overlap any existing allocated block
  */
 static bool verify_block(void *ptr, size_t size, script_t *script, int lineno)
@@ -434,11 +750,11 @@ static bool verify_block(void *ptr, size_t size, script_t *script, int lineno)
     }
     if (ptr == NULL && size == 0) return true;
 
-    // block must lie within the extent of the heap
+    // block must lie within the extent of the heap, or a region mapped for it
     void *end = (char *)ptr + size;
     void *heap_end = (char *)heap_segment_start() + heap_segment_size();
-    if (ptr < heap_segment_start() || end > heap_end) {
-        allocator_error(script, lineno, "New block (%p:%p) not within heap segment (%p:%p)",
+    if ((ptr < heap_segment_start() || end > heap_end) && !in_mapped_region(ptr, size)) {
+        allocator_error(script, lineno, "New block (%p:%p) not within heap segment (%p:%p) or a mapped region",
                         ptr, end, heap_segment_start(), heap_end);
         return false;
     }
@@ -565,6 +881,9 @@ static void usage()
    fprintf(stderr, "Usage: %s [-f <file-or-dir>]\n", program_invocation_short_name);
    fprintf(stderr, "\t-c                Run only the correctness tests (no checks for performance).\n");
    fprintf(stderr, "\t-p                Run only the performance tests (no checks for correctness).\n");
+   fprintf(stderr, "\t-l                Also report a histogram of per-request latency in cycles.\n");
+   fprintf(stderr, "\t-r                Also report heap segment size and resident memory through each script.\n");
+   fprintf(stderr, "\t-t <n>            Also replay each script in 1, 2, 4, ... n threads at once and report scaling.\n");
    fprintf(stderr, "\t-f <file-or-dir>  Use <file> as script or read all script files from <dir>.\n");
    fprintf(stderr, "Without -f option, reads scripts from default path: %s\n", DEFAULT_SCRIPT_DIR);
    exit(107);
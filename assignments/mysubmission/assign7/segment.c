@@ -2,23 +2,35 @@
  * ---------------
  * Handles low-level storage underneath the dynamic allocator. It reserves
  * the large memory segment using the OS-level mmap facility and then
- * opens it up on demand based on calls to extend.
+ * opens it up on demand based on calls to extend. It also maps separate
+ * regions outside the segment for blocks too large to carve from it, and
+ * keeps a table of them.
  */
 
+#define _GNU_SOURCE // for mremap
 #include "segment.h"
+#include <pthread.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 
 // Place the heap at lower address, as default addresses are quite high and easily
 // mistaken for stack addresses
 #define HEAP_START_HINT (void *)0x1070000000L
 
-// Entire segment is 8 GB
-#define MAX_SEGMENT_SIZE (1L << 33)
-
 // static variables track state of heap segment
 static void * segment_start = NULL;
 static size_t segment_size = 0;
 
+// table of regions mapped outside the segment, with their total size.
+// Threads map and unmap regions without holding any allocator lock
+typedef struct {
+    void *start;
+    size_t size;
+} region_t;
+static region_t *regions = NULL;
+static size_t nregions = 0, regions_capacity = 0, regions_size = 0;
+static pthread_mutex_t regions_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void *heap_segment_start()
 {
     return segment_start;
@@ -30,10 +42,17 @@ size_t heap_segment_size()
 }
 
 
-// Discard any previous segment by unmapping old segment
+// Discard any previous segment by unmapping old segment and regions
 // Re-initialize by reserving new segment with mmap
 void *init_heap_segment(size_t npages)
 {
+    pthread_mutex_lock(&regions_lock);
+    for (size_t i = 0; i < nregions; i++)
+        munmap(regions[i].start, regions[i].size);
+    nregions = 0;
+    __atomic_store_n(&regions_size, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&regions_lock);
+
     if (segment_start != NULL) { // discard existing segment
         if (munmap(segment_start, MAX_SEGMENT_SIZE) == -1) return NULL;
         segment_start = NULL;
@@ -62,3 +81,116 @@ void *extend_heap_segment(size_t npages)
     return previous_end;
 }
 
+
+// Shrink the segment and return its new end
+void *shrink_heap_segment(size_t npages)
+{
+    if (segment_start == NULL) return NULL;
+    size_t decrement_size = npages*PAGE_SIZE;
+    if (decrement_size > segment_size) return NULL;
+    segment_size -= decrement_size;
+    void *new_end = (char *)segment_start + segment_size;
+    // drop the pages, then fence them off as they were before extend
+    if (madvise(new_end, decrement_size, MADV_DONTNEED) == -1 ||
+        mprotect(new_end, decrement_size, PROT_NONE) == -1)
+        return NULL;
+    return new_end;
+}
+
+
+// Give the pages' memory back, leaving them mapped to read as zeros
+bool release_heap_pages(void *start, size_t npages)
+{
+    if (npages == 0) return true;
+    return madvise(start, npages*PAGE_SIZE, MADV_DONTNEED) == 0;
+}
+
+
+// Index of the region starting at start, nregions if there is none.
+// Caller must hold regions_lock
+static size_t find_region(void *start)
+{
+    size_t i = 0;
+    while (i < nregions && regions[i].start != start) i++;
+    return i;
+}
+
+
+// Map a new region and add it to the table
+void *map_region(size_t npages)
+{
+    size_t size = npages*PAGE_SIZE;
+    if (npages == 0 || size / PAGE_SIZE != npages) return NULL;
+    void *start = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED) return NULL;
+
+    pthread_mutex_lock(&regions_lock);
+    if (nregions == regions_capacity) {
+        size_t capacity = regions_capacity == 0 ? 16 : regions_capacity * 2;
+        region_t *grown = realloc(regions, capacity * sizeof(region_t));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&regions_lock);
+            munmap(start, size);
+            return NULL;
+        }
+        regions = grown;
+        regions_capacity = capacity;
+    }
+    regions[nregions++] = (region_t){.start = start, .size = size};
+    __atomic_store_n(&regions_size, regions_size + size, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&regions_lock);
+    return start;
+}
+
+
+// Resize a region with mremap, which moves its pages rather than copying
+void *remap_region(void *start, size_t npages)
+{
+    size_t size = npages*PAGE_SIZE;
+    if (npages == 0 || size / PAGE_SIZE != npages) return NULL;
+
+    pthread_mutex_lock(&regions_lock);
+    size_t i = find_region(start);
+    void *moved = MAP_FAILED;
+    if (i < nregions && (moved = mremap(start, regions[i].size, size, MREMAP_MAYMOVE)) != MAP_FAILED) {
+        __atomic_store_n(&regions_size, regions_size + size - regions[i].size, __ATOMIC_RELAXED);
+        regions[i] = (region_t){.start = moved, .size = size};
+    }
+    pthread_mutex_unlock(&regions_lock);
+    return moved == MAP_FAILED ? NULL : moved;
+}
+
+
+// Unmap a region and drop it from the table
+bool unmap_region(void *start)
+{
+    pthread_mutex_lock(&regions_lock);
+    size_t i = find_region(start);
+    bool found = i < nregions;
+    if (found) {
+        munmap(start, regions[i].size);
+        __atomic_store_n(&regions_size, regions_size - regions[i].size, __ATOMIC_RELAXED);
+        regions[i] = regions[--nregions];
+    }
+    pthread_mutex_unlock(&regions_lock);
+    return found;
+}
+
+
+// read without the lock, as the test harness asks after every request
+size_t mapped_region_size()
+{
+    return __atomic_load_n(&regions_size, __ATOMIC_RELAXED);
+}
+
+
+bool in_mapped_region(void *ptr, size_t size)
+{
+    bool found = false;
+    pthread_mutex_lock(&regions_lock);
+    for (size_t i = 0; i < nregions && !found; i++)
+        found = (char *)ptr >= (char *)regions[i].start &&
+                (char *)ptr + size <= (char *)regions[i].start + regions[i].size;
+    pthread_mutex_unlock(&regions_lock);
+    return found;
+}
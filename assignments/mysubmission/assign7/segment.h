@@ -10,6 +10,7 @@
 
 #ifndef _SEGMENT_H_
 #define _SEGMENT_H_
+#include <stdbool.h> // for bool
 #include <stddef.h> // for size_t
 
 /* Constants
@@ -20,6 +21,12 @@
  */
 #define PAGE_SIZE 4096
 
+/* Constant: MAX_SEGMENT_SIZE
+ * --------------------------
+ * The most bytes the heap segment can ever be extended to (8 GB).
+ */
+#define MAX_SEGMENT_SIZE (1L << 33)
+
 
 /* Function: init_heap_segment
  * ---------------------------
@@ -48,6 +55,67 @@ void *init_heap_segment(size_t npages);
 void *extend_heap_segment(size_t npages);
 
 
+/* Function: shrink_heap_segment
+ * -----------------------------
+ * This function is called to shrink the existing heap segment by npages
+ * from its end, giving those pages back to the OS. Their contents are lost
+ * and they can no longer be accessed until the segment is extended over
+ * them again. Returns the new end of the heap segment, or NULL if the
+ * segment is not that large.
+ */
+void *shrink_heap_segment(size_t npages);
+
+
+/* Function: release_heap_pages
+ * ----------------------------
+ * This function is called to give the memory backing npages of the heap
+ * segment starting at the page-aligned address start back to the OS,
+ * without shrinking the segment. The pages stay accessible and read as
+ * zeros until written again. Returns true on success.
+ */
+bool release_heap_pages(void *start, size_t npages);
+
+
+/* Function: map_region
+ * --------------------
+ * This function is called to map a region of npages, separate from the heap
+ * segment, for an allocator to use for one large block. The region is
+ * readable and writable, and counts toward mapped_region_size until it is
+ * unmapped. Regions are discarded when init_heap_segment is called.
+ * Returns the page-aligned start of the region, or NULL on failure.
+ */
+void *map_region(size_t npages);
+
+
+/* Function: remap_region
+ * ----------------------
+ * This function is called to resize the region at start, previously
+ * returned by map_region or remap_region, to npages. The kernel moves the
+ * pages if the region cannot grow where it is, keeping the contents
+ * without copying them. Returns the new start of the region, or NULL on
+ * failure, leaving the region as it was.
+ */
+void *remap_region(void *start, size_t npages);
+
+
+/* Function: unmap_region
+ * ----------------------
+ * This function is called to give the region at start back to the OS.
+ * Returns false if start is not the start of a mapped region.
+ */
+bool unmap_region(void *start);
+
+
+/* Functions: mapped_region_size, in_mapped_region
+ * -----------------------------------------------
+ * mapped_region_size returns the total size in bytes of the regions
+ * currently mapped. in_mapped_region returns true if the size bytes at ptr
+ * lie within one mapped region.
+ */
+size_t mapped_region_size(void);
+bool in_mapped_region(void *ptr, size_t size);
+
+
 /* Functions: heap_segment_start, heap_segment_size
  * ------------------------------------------------
  * heap_segment_start returns the base address of the current heap segment